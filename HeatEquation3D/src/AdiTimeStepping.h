@@ -0,0 +1,283 @@
+/// alternating direction implicit (ADI) timesteps with tridiagonal solves along x, y and z distributed over the ranks.
+
+/**
+ * With A = Ax + Ay + Az from Laplacian.h split by direction, the Douglas scheme in delta form reads
+ *
+ * (I + theta tau alpha Ax) d1 = -tau alpha A T[n]
+ * (I + theta tau alpha Ay) d2 = d1
+ * (I + theta tau alpha Az) d3 = d2
+ * T[n+1] = T[n] + d3
+ *
+ * which is unconditionally stable for 1/2 <= theta <= 1 (Douglas and Gunn, 1964), second order accurate in time for
+ * theta = 1/2 and first order for theta = 1 (Douglas-Rachford). The timestep tau is thus not limited by the CFL
+ * condition of the explicit time loop. Unlike ImplicitTimeStepping, each timestep costs a fixed amount of work, one
+ * application of A and three tridiagonal solves per line, but a very large tau damps the error only slowly, as the
+ * factorisation error grows with tau. For theta = 1/2, the amplification of the highest frequencies approaches one
+ * for large tau, theta = 1 damps them without oscillations.
+ *
+ * The lines in each direction run across the ranks along that coordinate, so the tridiagonal systems are solved with
+ * a pipelined Thomas algorithm between the neighbors from MPI_Cart_shift: each rank receives the last eliminated
+ * value of every line from its lower neighbor, eliminates its own segment and passes the last value on to the upper
+ * neighbor, then the back substitution runs the other way. The lines are split into batches, such that a rank starts
+ * on the next batch while its upper neighbor works on the previous one. As the coefficients are the same for all
+ * lines, the factorisation is computed once in the constructor, only the right hand sides are communicated.
+ *
+ * The nodes on the plane shared by two neighbors (see Laplacian.h) are eliminated by the upper one, the lower one
+ * receives their value in the back substitution. Like ImplicitTimeStepping, every unknown is integrated.
+ */
+
+#ifndef ADITIMESTEPPING_H
+#define ADITIMESTEPPING_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "Laplacian.h"
+#include "Stencil.h"
+#include "Threading.h"
+
+template<typename floatT>
+class AdiTimeStepping
+{
+public:
+    /**
+     * neighbors, chunk, spacing, nodes and offset as for RedBlackSOR, timestep is tau, alpha the thermal conductivity
+     * and theta the implicitness of the Douglas scheme. The lines of each sweep are pipelined in batches.
+     */
+    AdiTimeStepping(MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2],
+        const unsigned chunk[NUMBER_OF_DIMENSIONS], const floatT spacing[NUMBER_OF_DIMENSIONS],
+        const unsigned nodes[NUMBER_OF_DIMENSIONS], const unsigned offset[NUMBER_OF_DIMENSIONS], floatT timestep,
+        floatT alpha, floatT theta, int batches)
+        : comm_(comm), op_(comm, neighbors, chunk, spacing), timestep_(timestep), alpha_(alpha), theta_(theta),
+          batches_(std::max(1, batches)), delta_(chunk[X], chunk[Y], chunk[Z])
+    {
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            neighbors_[2 * coordinate] = neighbors[2 * coordinate];
+            neighbors_[2 * coordinate + 1] = neighbors[2 * coordinate + 1];
+            weight_[coordinate] = theta * timestep * alpha * op_.coefficient(coordinate);
+            factorise(coordinate, nodes[coordinate], offset[coordinate], chunk[coordinate]);
+        }
+    }
+
+    /// advance y0 by one timestep into y, the change of the interior nodes is added to residual
+    /**
+     * y0 has to hold the boundary values, y is overwritten.
+     */
+    void advance(const Field3D<floatT>& y0, Field3D<floatT>& y, Residual<floatT>* residual)
+    {
+        y = y0;
+        op_.exchange(y);
+        op_.apply(y, delta_);
+
+        /// the right hand side -tau alpha A T[n] is scaled during the elimination of the first sweep
+        sweep(X, -timestep_ * alpha_);
+        sweep(Y, 1.0);
+        sweep(Z, 1.0);
+
+        const Field3D<floatT>& delta = delta_;
+        op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+            floatT* t = &y(i, j, 0);
+            const floatT* d = &delta(i, j, 0);
+            HEAT3D_OMP(simd)
+            for (int k = kBegin; k < kEnd; ++k)
+                t[k] += d[k];
+        });
+        ++timesteps_;
+
+        if (residual)
+            reduceChange(y0, y, *residual);
+    }
+
+    floatT timestep() const { return timestep_; }
+    floatT theta() const { return theta_; }
+    int batches() const { return batches_; }
+
+    /// the number of timesteps taken
+    unsigned timesteps() const { return timesteps_; }
+
+private:
+    /// the Thomas factorisation of I + theta tau alpha A along one coordinate, for the local nodes of the global line
+    /**
+     * row g of the global system reads -w d[g-1] + (1 + 2 w) d[g] - w d[g+1] = r[g] for the unknowns
+     * g = 1 ... nodes - 2, d is zero on the boundary. The elimination is d'[g] = (r[g] + w d'[g-1]) inverse[g] and
+     * the back substitution d[g] = d'[g] - upper[g] d[g+1].
+     */
+    void factorise(int coordinate, unsigned nodes, unsigned offset, unsigned size)
+    {
+        const floatT w = weight_[coordinate];
+        std::vector<floatT> inverse(nodes, 0.0), upper(nodes, 0.0);
+        for (unsigned g = 1; g + 1 < nodes; ++g) {
+            inverse[g] = 1.0 / (1.0 + 2.0 * w + w * upper[g - 1]);
+            upper[g] = -w * inverse[g];
+        }
+        inverse_[coordinate].assign(inverse.begin() + offset, inverse.begin() + offset + size);
+        upper_[coordinate].assign(upper.begin() + offset, upper.begin() + offset + size);
+    }
+
+    /// solve the tridiagonal systems of all lines along one coordinate in place on delta_, scaling the right hand side
+    void sweep(int coordinate, floatT scale)
+    {
+        /// the lines are indexed by (p, q) in the other two coordinates, q is contiguous in memory unless lines run in z
+        const int p = coordinate == X ? Y : X;
+        const int q = coordinate == Z ? Y : Z;
+        const NodeRange& u = op_.unknowns();
+        const NodeRange& o = op_.owned();
+        const int lower = neighbors_[2 * coordinate];
+        const int upperNeighbor = neighbors_[2 * coordinate + 1];
+        const int first = u.lo[coordinate];
+        const int last = o.hi[coordinate];
+        const int lines = (u.hi[p] - u.lo[p]) * (u.hi[q] - u.lo[q]);
+        const int width = u.hi[q] - u.lo[q];
+        const std::ptrdiff_t stride[NUMBER_OF_DIMENSIONS] = { delta_.strideX(), delta_.strideY(), 1 };
+        const std::ptrdiff_t along = stride[coordinate];
+        const floatT w = weight_[coordinate];
+        const floatT* inverse = inverse_[coordinate].data();
+        const floatT* upper = upper_[coordinate].data();
+        floatT* origin = delta_.origin();
+
+        sendForward_.resize(lines);
+        sendBackward_.resize(lines);
+        receive_.resize(lines);
+        requests_.clear();
+
+        /// batch b holds the lines with p in [batchBegin(b), batchBegin(b + 1)), its values start at (p - u.lo[p]) width
+        const int batches = std::min(batches_, u.hi[p] - u.lo[p]);
+        auto batchBegin = [&](int b) { return u.lo[p] + (u.hi[p] - u.lo[p]) * b / batches; };
+        auto lineStart = [&](int pp, int qq) { return origin + pp * stride[p] + qq * stride[q]; };
+
+        for (int b = 0; b < batches; ++b) {
+            const int pBegin = batchBegin(b), pEnd = batchBegin(b + 1);
+            const std::size_t begin = static_cast<std::size_t>(pBegin - u.lo[p]) * width;
+            const int count = (pEnd - pBegin) * width;
+            floatT* previous = receive_.data() + begin;
+            if (lower != MPI_PROC_NULL)
+                MPI_Recv(previous, count, mpiDatatype<floatT>(), lower, ADI_FORWARD_TAG + coordinate, comm_,
+                    MPI_STATUS_IGNORE);
+            else
+                std::fill(previous, previous + count, floatT(0.0));
+
+            /// elimination d'[i] = (scale r[i] + w d'[i-1]) inverse[i] on the owned nodes
+            floatT* out = sendForward_.data() + begin;
+            HEAT3D_OMP(parallel for schedule(static))
+            for (int pp = pBegin; pp < pEnd; ++pp) {
+                const floatT* before = previous + static_cast<std::size_t>(pp - pBegin) * width - u.lo[q];
+                floatT* after = out + static_cast<std::size_t>(pp - pBegin) * width - u.lo[q];
+                if (coordinate == Z) {
+                    for (int qq = u.lo[q]; qq < u.hi[q]; ++qq) {
+                        floatT* line = lineStart(pp, qq);
+                        floatT value = before[qq];
+                        for (int i = first; i < last; ++i)
+                            line[i] = value = (scale * line[i] + w * value) * inverse[i];
+                        after[qq] = value;
+                    }
+                    continue;
+                }
+                floatT* row = lineStart(pp, 0) + first * along;
+                HEAT3D_OMP(simd)
+                for (int qq = u.lo[q]; qq < u.hi[q]; ++qq)
+                    row[qq] = (scale * row[qq] + w * before[qq]) * inverse[first];
+                for (int i = first + 1; i < last; ++i) {
+                    floatT* current = lineStart(pp, 0) + i * along;
+                    const floatT* below = current - along;
+                    const floatT factor = inverse[i];
+                    HEAT3D_OMP(simd)
+                    for (int qq = u.lo[q]; qq < u.hi[q]; ++qq)
+                        current[qq] = (scale * current[qq] + w * below[qq]) * factor;
+                }
+                const floatT* top = lineStart(pp, 0) + (last - 1) * along;
+                for (int qq = u.lo[q]; qq < u.hi[q]; ++qq)
+                    after[qq] = top[qq];
+            }
+
+            if (upperNeighbor != MPI_PROC_NULL) {
+                requests_.emplace_back();
+                MPI_Isend(out, count, mpiDatatype<floatT>(), upperNeighbor, ADI_FORWARD_TAG + coordinate, comm_,
+                    &requests_.back());
+            }
+        }
+
+        for (int b = 0; b < batches; ++b) {
+            const int pBegin = batchBegin(b), pEnd = batchBegin(b + 1);
+            const std::size_t begin = static_cast<std::size_t>(pBegin - u.lo[p]) * width;
+            const int count = (pEnd - pBegin) * width;
+            floatT* next = receive_.data() + begin;
+            if (upperNeighbor != MPI_PROC_NULL)
+                MPI_Recv(next, count, mpiDatatype<floatT>(), upperNeighbor, ADI_BACKWARD_TAG + coordinate, comm_,
+                    MPI_STATUS_IGNORE);
+            else
+                std::fill(next, next + count, floatT(0.0));
+
+            /// back substitution d[i] = d'[i] - upper[i] d[i+1], the shared plane (if any) receives the upper values
+            floatT* out = sendBackward_.data() + begin;
+            HEAT3D_OMP(parallel for schedule(static))
+            for (int pp = pBegin; pp < pEnd; ++pp) {
+                const floatT* above = next + static_cast<std::size_t>(pp - pBegin) * width - u.lo[q];
+                floatT* after = out + static_cast<std::size_t>(pp - pBegin) * width - u.lo[q];
+                if (coordinate == Z) {
+                    for (int qq = u.lo[q]; qq < u.hi[q]; ++qq) {
+                        floatT* line = lineStart(pp, qq);
+                        floatT value = above[qq];
+                        if (upperNeighbor != MPI_PROC_NULL)
+                            line[last] = value;
+                        for (int i = last - 1; i >= first; --i)
+                            line[i] = value = line[i] - upper[i] * value;
+                        after[qq] = line[first];
+                    }
+                    continue;
+                }
+                if (upperNeighbor != MPI_PROC_NULL) {
+                    floatT* shared = lineStart(pp, 0) + last * along;
+                    for (int qq = u.lo[q]; qq < u.hi[q]; ++qq)
+                        shared[qq] = above[qq];
+                }
+                floatT* row = lineStart(pp, 0) + (last - 1) * along;
+                HEAT3D_OMP(simd)
+                for (int qq = u.lo[q]; qq < u.hi[q]; ++qq)
+                    row[qq] -= upper[last - 1] * above[qq];
+                for (int i = last - 2; i >= first; --i) {
+                    floatT* current = lineStart(pp, 0) + i * along;
+                    const floatT* aboveRow = current + along;
+                    const floatT factor = upper[i];
+                    HEAT3D_OMP(simd)
+                    for (int qq = u.lo[q]; qq < u.hi[q]; ++qq)
+                        current[qq] -= factor * aboveRow[qq];
+                }
+                const floatT* bottom = lineStart(pp, 0) + first * along;
+                for (int qq = u.lo[q]; qq < u.hi[q]; ++qq)
+                    after[qq] = bottom[qq];
+            }
+
+            if (lower != MPI_PROC_NULL) {
+                requests_.emplace_back();
+                MPI_Isend(out, count, mpiDatatype<floatT>(), lower, ADI_BACKWARD_TAG + coordinate, comm_,
+                    &requests_.back());
+            }
+        }
+
+        MPI_Waitall(static_cast<int>(requests_.size()), requests_.data(), MPI_STATUSES_IGNORE);
+    }
+
+    static constexpr int ADI_FORWARD_TAG = 500;
+    static constexpr int ADI_BACKWARD_TAG = 510;
+
+    MPI_Comm comm_;
+    Laplacian<floatT> op_;
+    int neighbors_[NUMBER_OF_DIMENSIONS * 2];
+    floatT timestep_;
+    floatT alpha_;
+    floatT theta_;
+    int batches_;
+    floatT weight_[NUMBER_OF_DIMENSIONS];
+    std::vector<floatT> inverse_[NUMBER_OF_DIMENSIONS];
+    std::vector<floatT> upper_[NUMBER_OF_DIMENSIONS];
+    Field3D<floatT> delta_;
+    std::vector<floatT> sendForward_, sendBackward_, receive_;
+    std::vector<MPI_Request> requests_;
+    unsigned timesteps_ = 0;
+};
+
+#endif
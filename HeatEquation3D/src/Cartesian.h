@@ -0,0 +1,38 @@
+/// enums and helpers describing the cartesian decomposition of the domain, shared by all parts of the solver.
+
+#ifndef CARTESIAN_H
+#define CARTESIAN_H
+
+#include "mpi.h"
+
+/// enum used to index over the respective coordinate direction
+enum COORDINATE { X = 0, Y, Z };
+
+/// enum used to access the respective direction on each local processor
+/**
+ *  0: LEFT
+ *  1: RIGHT
+ *  2: BOTTOM
+ *  3: TOP
+ *  4: BACK
+ *  5: FRONT
+ *
+ * the direction 2 * c lies on the lower and the direction 2 * c + 1 on the upper side of coordinate c.
+ */
+enum DIRECTION { LEFT = 0, RIGHT, BOTTOM, TOP, BACK, FRONT };
+
+/// the number of physical dimensions, here 3 as we have a 3D domain
+#define NUMBER_OF_DIMENSIONS 3
+
+/// the direction on the opposite side of the sub-domain, i.e. LEFT <-> RIGHT, BOTTOM <-> TOP and BACK <-> FRONT
+inline int opposite(int direction)
+{
+    return direction ^ 1;
+}
+
+/// the MPI datatype matching a floating point type
+template<typename T> inline MPI_Datatype mpiDatatype();
+template<> inline MPI_Datatype mpiDatatype<float>() { return MPI_FLOAT; }
+template<> inline MPI_Datatype mpiDatatype<double>() { return MPI_DOUBLE; }
+
+#endif
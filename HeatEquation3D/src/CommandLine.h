@@ -0,0 +1,69 @@
+/// optional command line arguments of the form --name=value (or just --name for switches).
+
+/**
+ * The five positional arguments (number of cells, iterations and convergence threshold) are still required and parsed
+ * in main(). Everything after them is optional and collected here, so that each feature can look up its own settings
+ * without changing the order of the required arguments.
+ */
+
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+class CommandLine
+{
+public:
+    CommandLine(int argc, char** argv, int firstOption)
+    {
+        for (int index = firstOption; index < argc; ++index) {
+            std::string argument(argv[index]);
+            if (argument.compare(0, 2, "--") != 0) {
+                invalid_.push_back(argument);
+                continue;
+            }
+            auto separator = argument.find('=');
+            if (separator == std::string::npos)
+                options_[argument.substr(2)] = "";
+            else
+                options_[argument.substr(2, separator - 2)] = argument.substr(separator + 1);
+        }
+    }
+
+    bool has(const std::string& name) const
+    {
+        return options_.count(name) > 0;
+    }
+
+    std::string get(const std::string& name, const std::string& fallback) const
+    {
+        auto option = options_.find(name);
+        return option == options_.end() ? fallback : option->second;
+    }
+
+    int get(const std::string& name, int fallback) const
+    {
+        auto option = options_.find(name);
+        return option == options_.end() || option->second.empty() ? fallback : std::stoi(option->second);
+    }
+
+    double get(const std::string& name, double fallback) const
+    {
+        auto option = options_.find(name);
+        return option == options_.end() || option->second.empty() ? fallback : std::stod(option->second);
+    }
+
+    /// all options that were given, used to echo the configuration on screen
+    const std::map<std::string, std::string>& options() const { return options_; }
+
+    /// arguments that did not follow the --name=value syntax
+    const std::vector<std::string>& invalid() const { return invalid_; }
+
+private:
+    std::map<std::string, std::string> options_;
+    std::vector<std::string> invalid_;
+};
+
+#endif
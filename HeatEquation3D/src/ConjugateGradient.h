@@ -0,0 +1,355 @@
+/// matrix-free, preconditioned Conjugate Gradient solver for the steady state on the distributed grid.
+
+/**
+ * A (see Laplacian.h) is symmetric and positive definite, so CG converges to the steady state in O(N) iterations for
+ * N nodes per direction, compared to the O(N^2) timesteps of the explicit time loop. Each iteration applies A once,
+ * with one halo exchange, and needs two global reductions: p.Ap and, fused into one MPI_Iallreduce, r.z and r.r.
+ *
+ * Two preconditioners M ~ A^-1 are available:
+ *
+ * - jacobi:    z = r / diagonal. As the diagonal of A is constant, this is a scaling only and does not change the
+ *              number of iterations, it is the baseline the other preconditioner is compared against.
+ * - chebyshev: z = p(D^-1 A) D^-1 r, where p is the polynomial of the given degree for which the Chebyshev iteration
+ *              applied to A z = r converges fastest. The eigenvalues of D^-1 A for the constant coefficient Laplacian
+ *              with Dirichlet boundaries are known in closed form, no estimate is needed. Every degree costs one more
+ *              application of A (and halo exchange), but no global reduction, so it reduces the number of reductions
+ *              by about the degree.
+ *
+ * Both reductions of an iteration are blocking, and at large processor counts their latency dominates. The pipelined
+ * variant (Ghysels and Vanroose, "Hiding global synchronization latency in the preconditioned Conjugate Gradient
+ * algorithm", 2014) rewrites the recurrences such that all three dot products of an iteration are independent of the
+ * preconditioner and the application of A that follow them. They are reduced with a single MPI_Iallreduce, which is in
+ * flight while M and A (including its halo exchange) are applied, and only waited for afterwards. This costs four more
+ * fields and a few more vector updates, and rounding errors accumulate slightly faster in the recurrences.
+ */
+
+#ifndef CONJUGATEGRADIENT_H
+#define CONJUGATEGRADIENT_H
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ios>
+#include <ostream>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "Laplacian.h"
+#include "Threading.h"
+
+template<typename floatT>
+class ConjugateGradient
+{
+public:
+    enum Preconditioner { JACOBI, CHEBYSHEV };
+
+    struct Settings
+    {
+        Preconditioner preconditioner = JACOBI;
+
+        /// degree of the Chebyshev polynomial, i.e. the applications of A per preconditioning step
+        int chebyshevDegree = 4;
+
+        /// use the pipelined variant with one non-blocking reduction per iteration
+        bool pipelined = false;
+
+        /// solve (A + shift I) x = b instead, see Laplacian.h
+        floatT shift = 0.0;
+    };
+
+    /// time spent in the global reductions, see report(...)
+    struct Timing
+    {
+        unsigned reductions = 0;
+
+        /// time from the start of each reduction until it completed
+        double inFlight = 0.0;
+
+        /// time spent waiting for the reductions to complete, i.e. the latency that was not hidden
+        double waiting = 0.0;
+    };
+
+    /// neighbors, chunk and spacing as in main(), nodes is the global number of nodes in each direction
+    ConjugateGradient(MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2],
+        const unsigned chunk[NUMBER_OF_DIMENSIONS], const floatT spacing[NUMBER_OF_DIMENSIONS],
+        const unsigned nodes[NUMBER_OF_DIMENSIONS], const Settings& settings)
+        : op_(comm, neighbors, chunk, spacing, settings.shift), settings_(settings)
+    {
+        Field3D<floatT>* fields[] = { &x_, &b_, &r_, &z_, &p_, &q_ };
+        for (Field3D<floatT>* field : fields)
+            field->resize(chunk[X], chunk[Y], chunk[Z]);
+        if (settings_.pipelined) {
+            Field3D<floatT>* pipeline[] = { &u_, &w_, &m_, &n_, &s_ };
+            for (Field3D<floatT>* field : pipeline)
+                field->resize(chunk[X], chunk[Y], chunk[Z]);
+        }
+        if (settings_.preconditioner == CHEBYSHEV) {
+            chebyshevDirection_.resize(chunk[X], chunk[Y], chunk[Z]);
+            chebyshevResidual_.resize(chunk[X], chunk[Y], chunk[Z]);
+        }
+
+        /// extreme eigenvalues of D^-1 A, for the lowest and highest mode in each direction
+        const floatT pi = std::acos(floatT(-1.0));
+        lambdaMin_ = 1.0;
+        lambdaMax_ = 1.0;
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            const floatT weight = 2.0 * op_.coefficient(coordinate) / op_.diagonal();
+            const floatT cosine = std::cos(pi / (nodes[coordinate] - 1.0));
+            lambdaMin_ -= weight * cosine;
+            lambdaMax_ += weight * cosine;
+        }
+    }
+
+    /// the solution, holding the Dirichlet values on the boundary
+    Field3D<floatT>& solution() { return x_; }
+
+    /// the right hand side, zero for Laplace's equation
+    Field3D<floatT>& rightHandSide() { return b_; }
+
+    /// iterate until the L2-norm of the residual dropped by tolerance or maxIterations were taken
+    /**
+     * returns the number of iterations taken, solution() is used as the initial guess.
+     */
+    unsigned solve(floatT tolerance, unsigned maxIterations)
+    {
+        timing_ = Timing();
+        return settings_.pipelined ? solvePipelined(tolerance, maxIterations) : solveClassic(tolerance, maxIterations);
+    }
+
+    /// L2-norm of the residual before the first and after the last iteration of solve(...)
+    floatT initialResidual() const { return initialResidual_; }
+    floatT residual() const { return residual_; }
+
+    /// the bounds of the spectrum of D^-1 A used by the Chebyshev preconditioner
+    floatT lambdaMin() const { return lambdaMin_; }
+    floatT lambdaMax() const { return lambdaMax_; }
+
+    /// time spent in the global reductions during the last solve(...) on this processor
+    const Timing& timing() const { return timing_; }
+
+    /// print the time spent in the reductions and how much of it was hidden behind computation and halo exchanges
+    void report(std::ostream& out, double totalTime) const
+    {
+        const double hidden = timing_.inFlight - timing_.waiting;
+        const std::ios_base::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out << "Global reductions: " << timing_.reductions << ", " << std::scientific << std::setprecision(5)
+            << timing_.inFlight << " s in flight, " << timing_.waiting << " s waited for, " << hidden << " s hidden ("
+            << std::fixed << std::setprecision(1) << (timing_.inFlight > 0.0 ? 100.0 * hidden / timing_.inFlight : 0.0)
+            << " %), " << (totalTime > 0.0 ? 100.0 * timing_.waiting / totalTime : 0.0) << " % of the solver time"
+            << std::endl;
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    unsigned solveClassic(floatT tolerance, unsigned maxIterations)
+    {
+        op_.exchange(x_);
+        op_.residual(x_, b_, r_);
+        precondition(r_, z_);
+
+        floatT products[2] = { op_.localDot(r_, z_), op_.localDot(r_, r_) };
+        reduce(products, 2);
+        floatT rz = products[0];
+        initialResidual_ = residual_ = std::sqrt(products[1]);
+        op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+            std::copy(&z_(i, j, kBegin), &z_(i, j, kEnd), &p_(i, j, kBegin));
+        });
+
+        unsigned iterations = 0;
+        while (iterations < maxIterations && residual_ > tolerance * initialResidual_) {
+            op_.exchange(p_);
+            op_.apply(p_, q_);
+            floatT pq = op_.localDot(p_, q_);
+            reduce(&pq, 1);
+            const floatT alpha = rz / pq;
+
+            op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+                floatT* x = &x_(i, j, 0);
+                floatT* r = &r_(i, j, 0);
+                const floatT* p = &p_(i, j, 0);
+                const floatT* q = &q_(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = kBegin; k < kEnd; ++k) {
+                    x[k] += alpha * p[k];
+                    r[k] -= alpha * q[k];
+                }
+            });
+            precondition(r_, z_);
+
+            products[0] = op_.localDot(r_, z_);
+            products[1] = op_.localDot(r_, r_);
+            reduce(products, 2);
+            const floatT beta = products[0] / rz;
+            rz = products[0];
+            residual_ = std::sqrt(products[1]);
+
+            op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+                floatT* p = &p_(i, j, 0);
+                const floatT* z = &z_(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = kBegin; k < kEnd; ++k)
+                    p[k] = z[k] + beta * p[k];
+            });
+            ++iterations;
+        }
+        return iterations;
+    }
+
+    /// algorithm 4 of Ghysels and Vanroose, u = M r, w = A u, m = M w and n = A m are kept up to date by recurrences
+    unsigned solvePipelined(floatT tolerance, unsigned maxIterations)
+    {
+        op_.exchange(x_);
+        op_.residual(x_, b_, r_);
+        precondition(r_, u_);
+        op_.exchange(u_);
+        op_.apply(u_, w_);
+
+        floatT gammaOld = 1.0, alphaOld = 1.0;
+        unsigned iterations = 0;
+        while (true) {
+            /// gamma = r.u, delta = w.u and r.r are started together and reduced during M and A below
+            floatT products[3] = { op_.localDot(r_, u_), op_.localDot(w_, u_), op_.localDot(r_, r_) };
+            MPI_Request request;
+            const double start = MPI_Wtime();
+            op_.startSum(products, 3, request);
+
+            precondition(w_, m_);
+            op_.exchange(m_);
+            op_.apply(m_, n_);
+
+            const double wait = MPI_Wtime();
+            MPI_Wait(&request, MPI_STATUS_IGNORE);
+            const double end = MPI_Wtime();
+            timing_.reductions += 1;
+            timing_.inFlight += end - start;
+            timing_.waiting += end - wait;
+
+            residual_ = std::sqrt(products[2]);
+            if (iterations == 0)
+                initialResidual_ = residual_;
+            if (iterations >= maxIterations || residual_ <= tolerance * initialResidual_)
+                break;
+
+            const floatT gamma = products[0];
+            const floatT delta = products[1];
+            const floatT beta = iterations == 0 ? 0.0 : gamma / gammaOld;
+            const floatT alpha = iterations == 0 ? gamma / delta : gamma / (delta - beta * gamma / alphaOld);
+            gammaOld = gamma;
+            alphaOld = alpha;
+
+            op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+                floatT* x = &x_(i, j, 0);
+                floatT* r = &r_(i, j, 0);
+                floatT* u = &u_(i, j, 0);
+                floatT* w = &w_(i, j, 0);
+                floatT* z = &z_(i, j, 0);
+                floatT* q = &q_(i, j, 0);
+                floatT* s = &s_(i, j, 0);
+                floatT* p = &p_(i, j, 0);
+                const floatT* m = &m_(i, j, 0);
+                const floatT* n = &n_(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = kBegin; k < kEnd; ++k) {
+                    z[k] = n[k] + beta * z[k];
+                    q[k] = m[k] + beta * q[k];
+                    s[k] = w[k] + beta * s[k];
+                    p[k] = u[k] + beta * p[k];
+                    x[k] += alpha * p[k];
+                    r[k] -= alpha * s[k];
+                    u[k] -= alpha * q[k];
+                    w[k] -= alpha * z[k];
+                }
+            });
+            ++iterations;
+        }
+        return iterations;
+    }
+
+    /// blocking sum over all processors, timed like the reductions of the pipelined variant
+    void reduce(floatT* values, int count)
+    {
+        const double start = MPI_Wtime();
+        op_.sum(values, count);
+        const double time = MPI_Wtime() - start;
+        timing_.reductions += 1;
+        timing_.inFlight += time;
+        timing_.waiting += time;
+    }
+
+    /// out = M in
+    void precondition(const Field3D<floatT>& in, Field3D<floatT>& out)
+    {
+        if (settings_.preconditioner == CHEBYSHEV) {
+            chebyshev(in, out);
+            return;
+        }
+
+        const floatT inverse = 1.0 / op_.diagonal();
+        op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+            floatT* z = &out(i, j, 0);
+            const floatT* r = &in(i, j, 0);
+            HEAT3D_OMP(simd)
+            for (int k = kBegin; k < kEnd; ++k)
+                z[k] = inverse * r[k];
+        });
+    }
+
+    /// z = p(D^-1 A) D^-1 r with degree steps of the Chebyshev iteration for A z = r, starting from z = 0
+    void chebyshev(const Field3D<floatT>& r, Field3D<floatT>& z)
+    {
+        const floatT theta = 0.5 * (lambdaMax_ + lambdaMin_);
+        const floatT delta = 0.5 * (lambdaMax_ - lambdaMin_);
+        const floatT sigma = theta / delta;
+        const floatT inverse = 1.0 / op_.diagonal();
+        floatT rho = 1.0 / sigma;
+        Field3D<floatT>& direction = chebyshevDirection_;
+        Field3D<floatT>& residual = chebyshevResidual_;
+
+        op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+            floatT* zRow = &z(i, j, 0);
+            floatT* dRow = &direction(i, j, 0);
+            const floatT* rRow = &r(i, j, 0);
+            HEAT3D_OMP(simd)
+            for (int k = kBegin; k < kEnd; ++k) {
+                dRow[k] = inverse / theta * rRow[k];
+                zRow[k] = dRow[k];
+            }
+        });
+
+        for (int degree = 1; degree < settings_.chebyshevDegree; ++degree) {
+            op_.exchange(z);
+            op_.residual(z, r, residual);
+
+            const floatT rhoNext = 1.0 / (2.0 * sigma - rho);
+            const floatT previous = rhoNext * rho;
+            const floatT correction = 2.0 * rhoNext / delta * inverse;
+            op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+                floatT* zRow = &z(i, j, 0);
+                floatT* dRow = &direction(i, j, 0);
+                const floatT* tRow = &residual(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = kBegin; k < kEnd; ++k) {
+                    dRow[k] = previous * dRow[k] + correction * tRow[k];
+                    zRow[k] += dRow[k];
+                }
+            });
+            rho = rhoNext;
+        }
+    }
+
+    Laplacian<floatT> op_;
+    Settings settings_;
+    Field3D<floatT> x_, b_, r_, z_, p_, q_;
+    Field3D<floatT> u_, w_, m_, n_, s_;
+    Field3D<floatT> chebyshevDirection_, chebyshevResidual_;
+    floatT lambdaMin_;
+    floatT lambdaMax_;
+    floatT initialResidual_ = 0.0;
+    floatT residual_ = 0.0;
+    Timing timing_;
+};
+
+#endif
@@ -0,0 +1,301 @@
+/// communication avoiding halo exchange with ghost layers that are several cells deep.
+
+/**
+ * With a ghost layer of width g, each processor receives g planes from every neighbor and can then take g timesteps
+ * without any further communication. In step m of such a block, all cells that are at least m cells away from the outer
+ * edge of the ghost layer can still be updated correctly. The updated region therefore shrinks by one cell per step on
+ * every side that borders a neighbor, and after g steps exactly the cells owned by the processor are up to date. The
+ * cells computed in the ghost layer are computed redundantly by both processors.
+ *
+ * As the 7-point stencil applied to ghost cells also needs the diagonal neighbors (edges and corners of the ghost
+ * layer), the exchange is done one coordinate direction after the other: the faces sent in y include the ghost layers
+ * just received in x, and the faces sent in z include those of x and y. This fills the edge and corner regions with
+ * only the six direct neighbors.
+ *
+ * Because every cell of the sub-domain, including edges and corners, is updated with the full stencil here, the result
+ * of a deep halo run is identical to that of a single processor run.
+ */
+
+#ifndef DEEPHALO_H
+#define DEEPHALO_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "TemporalBlocking.h"
+#include "Threading.h"
+
+template<typename floatT>
+class DeepHaloExchange
+{
+public:
+    DeepHaloExchange(MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2],
+        const unsigned chunk[NUMBER_OF_DIMENSIONS], unsigned width)
+        : comm_(comm), width_(static_cast<int>(width))
+    {
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+            neighbors_[direction] = neighbors[direction];
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+            size_[coordinate] = static_cast<int>(chunk[coordinate]);
+
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction) {
+            sendBuffer_[direction].resize(neighbors_[direction] != MPI_PROC_NULL ? cells(sendBox(direction)) : 1);
+            receiveBuffer_[direction].resize(neighbors_[direction] != MPI_PROC_NULL ? cells(receiveBox(direction)) : 1);
+        }
+    }
+
+    /// fill the ghost layers of field, the received values are written into mirror as well
+    /**
+     * mirror is the other buffer of the DoubleBuffer. Ghost cells that are not updated during a block (e.g. those
+     * holding a Dirichlet boundary value of the neighbor) are read from both buffers during the block.
+     */
+    void exchange(Field3D<floatT>& field, Field3D<floatT>& mirror)
+    {
+        exchange(field, &mirror, ALL_COLOURS, 0);
+    }
+
+    /// fill the ghost layers of a single field
+    void exchange(Field3D<floatT>& field)
+    {
+        exchange(field, nullptr, ALL_COLOURS, 0);
+    }
+
+    /// fill the ghost layers of a single field with the cells of one colour only, the others are left untouched
+    /**
+     * cell (i, j, k) has colour (i + j + k + parity) % 2, where parity makes the colour of a cell the same on all
+     * processors (see RedBlackSOR.h). Only half of the cells are sent.
+     */
+    void exchange(Field3D<floatT>& field, int colour, int parity)
+    {
+        exchange(field, nullptr, colour, parity);
+    }
+
+    /// the region updated during a block, see TemporalBlocking.h
+    TemporalRegion region() const
+    {
+        TemporalRegion region;
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            const bool lower = neighbors_[2 * coordinate] != MPI_PROC_NULL;
+            const bool upper = neighbors_[2 * coordinate + 1] != MPI_PROC_NULL;
+            region.lo[coordinate] = lower ? 1 - width_ : 1;
+            region.hi[coordinate] = upper ? size_[coordinate] + width_ - 1 : size_[coordinate] - 1;
+            region.shrinkLo[coordinate] = lower ? 1 : 0;
+            region.shrinkHi[coordinate] = upper ? 1 : 0;
+        }
+        return region;
+    }
+
+    unsigned width() const { return static_cast<unsigned>(width_); }
+
+private:
+    struct Box
+    {
+        int lo[NUMBER_OF_DIMENSIONS];
+        int hi[NUMBER_OF_DIMENSIONS];
+    };
+
+    static const int ALL_COLOURS = -1;
+
+    /// the exchange itself, mirror may be null
+    void exchange(Field3D<floatT>& field, Field3D<floatT>* mirror, int colour, int parity)
+    {
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            MPI_Request request[4];
+            for (int side = 0; side < 2; ++side) {
+                const int direction = 2 * coordinate + side;
+                if (neighbors_[direction] != MPI_PROC_NULL)
+                    pack(field, sendBox(direction), sendBuffer_[direction], colour, parity);
+
+                /// the tag identifies the direction in which the message travels, as seen by the sender
+                MPI_Irecv(&receiveBuffer_[direction][0], count(direction, receiveBox(direction), colour),
+                    mpiDatatype<floatT>(), neighbors_[direction], 500 + opposite(direction), comm_, &request[2 * side]);
+                MPI_Isend(&sendBuffer_[direction][0], count(direction, sendBox(direction), colour),
+                    mpiDatatype<floatT>(), neighbors_[direction], 500 + direction, comm_, &request[2 * side + 1]);
+            }
+            MPI_Waitall(4, request, MPI_STATUSES_IGNORE);
+
+            for (int side = 0; side < 2; ++side) {
+                const int direction = 2 * coordinate + side;
+                if (neighbors_[direction] != MPI_PROC_NULL) {
+                    unpack(receiveBuffer_[direction], receiveBox(direction), field, colour, parity);
+                    if (mirror)
+                        unpack(receiveBuffer_[direction], receiveBox(direction), *mirror, colour, parity);
+                }
+            }
+        }
+    }
+
+    /// the cells sent in the given direction, coordinates exchanged before this one include their ghost layers
+    Box sendBox(int direction) const
+    {
+        Box box = faceBox(direction);
+        const int coordinate = direction / 2;
+        if (direction % 2 == 0) {
+            box.lo[coordinate] = 1;
+            box.hi[coordinate] = 1 + width_;
+        }
+        else {
+            box.lo[coordinate] = size_[coordinate] - 1 - width_;
+            box.hi[coordinate] = size_[coordinate] - 1;
+        }
+        return box;
+    }
+
+    /// the ghost cells received from the given direction
+    Box receiveBox(int direction) const
+    {
+        Box box = faceBox(direction);
+        const int coordinate = direction / 2;
+        if (direction % 2 == 0) {
+            box.lo[coordinate] = -width_;
+            box.hi[coordinate] = 0;
+        }
+        else {
+            box.lo[coordinate] = size_[coordinate];
+            box.hi[coordinate] = size_[coordinate] + width_;
+        }
+        return box;
+    }
+
+    Box faceBox(int direction) const
+    {
+        Box box;
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            const bool exchanged = coordinate < direction / 2;
+            box.lo[coordinate] = exchanged ? -width_ : 0;
+            box.hi[coordinate] = exchanged ? size_[coordinate] + width_ : size_[coordinate];
+        }
+        return box;
+    }
+
+    static int cells(const Box& box)
+    {
+        return (box.hi[0] - box.lo[0]) * (box.hi[1] - box.lo[1]) * (box.hi[2] - box.lo[2]);
+    }
+
+    int count(int direction, const Box& box, int colour) const
+    {
+        return neighbors_[direction] != MPI_PROC_NULL ?
+            (box.hi[0] - box.lo[0]) * (box.hi[1] - box.lo[1]) * rowLength(box, colour) : 1;
+    }
+
+    /// number of buffer entries per row of a box, with a single colour every other cell of a row is sent
+    static int rowLength(const Box& box, int colour)
+    {
+        const int length = box.hi[2] - box.lo[2];
+        return colour == ALL_COLOURS ? length : (length + 1) / 2;
+    }
+
+    /// first cell of row (i, j) of a box that has the given colour
+    static int rowBegin(const Box& box, int i, int j, int colour, int parity)
+    {
+        return colour == ALL_COLOURS ? box.lo[2] : box.lo[2] + ((colour - i - j - parity - box.lo[2]) & 1);
+    }
+
+    /// position of row (i, j) in the buffer of a box, the rows of a box are shared among the threads
+    /**
+     * rows of the same global cells start with the same colour on both processors, so the buffer layout of sender and
+     * receiver agrees also when only one colour is exchanged.
+     */
+    static std::size_t rowIndex(const Box& box, int i, int j, int colour)
+    {
+        return (static_cast<std::size_t>(i - box.lo[0]) * (box.hi[1] - box.lo[1]) + (j - box.lo[1])) *
+            rowLength(box, colour);
+    }
+
+    static void pack(const Field3D<floatT>& field, const Box& box, std::vector<floatT>& buffer, int colour, int parity)
+    {
+        const int step = colour == ALL_COLOURS ? 1 : 2;
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = box.lo[0]; i < box.hi[0]; ++i)
+            for (int j = box.lo[1]; j < box.hi[1]; ++j) {
+                std::size_t index = rowIndex(box, i, j, colour);
+                for (int k = rowBegin(box, i, j, colour, parity); k < box.hi[2]; k += step)
+                    buffer[index++] = field(i, j, k);
+            }
+    }
+
+    static void unpack(const std::vector<floatT>& buffer, const Box& box, Field3D<floatT>& field, int colour,
+        int parity)
+    {
+        const int step = colour == ALL_COLOURS ? 1 : 2;
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = box.lo[0]; i < box.hi[0]; ++i)
+            for (int j = box.lo[1]; j < box.hi[1]; ++j) {
+                std::size_t index = rowIndex(box, i, j, colour);
+                for (int k = rowBegin(box, i, j, colour, parity); k < box.hi[2]; k += step)
+                    field(i, j, k) = buffer[index++];
+            }
+    }
+
+    MPI_Comm comm_;
+    int width_;
+    int neighbors_[NUMBER_OF_DIMENSIONS * 2];
+    int size_[NUMBER_OF_DIMENSIONS];
+    std::array<std::vector<floatT>, NUMBER_OF_DIMENSIONS * 2> sendBuffer_;
+    std::array<std::vector<floatT>, NUMBER_OF_DIMENSIONS * 2> receiveBuffer_;
+};
+
+/// predicted time per timestep for a ghost width, used to find the best width for a given network
+/**
+ * for a processor with neighbors on all six sides, a block of g steps costs
+ *
+ * sum over x, y, z of (latency + bytes(g) / bandwidth) + sum over m = 1 ... g of cells(m) * timePerCell
+ *
+ * where bytes(g) is the size of the faces exchanged in that direction and cells(m) the number of cells updated in step
+ * m, including the redundant ones in the ghost layer. The cost per timestep is that divided by g.
+ */
+inline double deepHaloTimePerStep(const unsigned chunk[NUMBER_OF_DIMENSIONS], unsigned width, double latency,
+    double bandwidth, double timePerCell, std::size_t bytesPerCell)
+{
+    const double g = width;
+    const double n[NUMBER_OF_DIMENSIONS] = { double(chunk[X]), double(chunk[Y]), double(chunk[Z]) };
+
+    /// faces in x are n_y * n_z, in y they include the ghost layers in x, in z those in x and y
+    const double faceCells[NUMBER_OF_DIMENSIONS] = {
+        g * n[Y] * n[Z],
+        g * (n[X] + 2.0 * g) * n[Z],
+        g * (n[X] + 2.0 * g) * (n[Y] + 2.0 * g)
+    };
+
+    double communication = 0.0;
+    for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+        communication += latency + 2.0 * faceCells[coordinate] * bytesPerCell / bandwidth;
+
+    double computation = 0.0;
+    for (unsigned step = 1; step <= width; ++step) {
+        const double extra = 2.0 * (g - step);
+        computation += (n[X] + extra) * (n[Y] + extra) * (n[Z] + extra) * timePerCell;
+    }
+
+    return (communication + computation) / g;
+}
+
+/// print the predicted time per timestep for ghost widths 1 ... maxWidth and return the best one
+inline unsigned reportDeepHaloModel(std::ostream& out, const unsigned chunk[NUMBER_OF_DIMENSIONS], unsigned maxWidth,
+    double latency, double bandwidth, double timePerCell, std::size_t bytesPerCell)
+{
+    unsigned best = 1;
+    double bestTime = deepHaloTimePerStep(chunk, 1, latency, bandwidth, timePerCell, bytesPerCell);
+
+    out << "ghost width    predicted time per timestep" << std::endl;
+    for (unsigned width = 1; width <= maxWidth; ++width) {
+        const double time = deepHaloTimePerStep(chunk, width, latency, bandwidth, timePerCell, bytesPerCell);
+        out << std::setw(11) << width << std::scientific << std::setprecision(5) << std::setw(32) << time
+            << " s" << std::endl;
+        if (time < bestTime) {
+            bestTime = time;
+            best = width;
+        }
+    }
+    return best;
+}
+
+#endif
@@ -0,0 +1,61 @@
+/// ping-pong storage for the current and the previous solution of the time loop.
+
+/**
+ * Instead of copying the whole solution into T0 at the start of each timestep, we keep two Field3D buffers and only
+ * exchange their roles. swap() is O(1), it exchanges the underlying storage of both buffers without touching any
+ * data. References obtained through current() and previous() stay valid across swaps, i.e. current() always refers to
+ * the buffer that is written during this timestep and previous() to the one holding the last solution.
+ *
+ * Only cells that are updated during each timestep change between the two buffers. Every other cell (e.g. Dirichlet
+ * boundary values) must therefore be identical in both buffers, which is ensured by calling synchronise() once after
+ * the initial and boundary conditions have been applied to current().
+ */
+
+#ifndef DOUBLEBUFFER_H
+#define DOUBLEBUFFER_H
+
+#include "Field3D.h"
+
+template<typename T>
+class DoubleBuffer
+{
+public:
+    DoubleBuffer() = default;
+
+    DoubleBuffer(unsigned sizeX, unsigned sizeY, unsigned sizeZ, unsigned ghost = 1)
+    {
+        resize(sizeX, sizeY, sizeZ, ghost);
+    }
+
+    void resize(unsigned sizeX, unsigned sizeY, unsigned sizeZ, unsigned ghost = 1)
+    {
+        current_.resize(sizeX, sizeY, sizeZ, ghost);
+        previous_.resize(sizeX, sizeY, sizeZ, ghost);
+    }
+
+    /// the buffer receiving the new solution
+    Field3D<T>& current() { return current_; }
+    const Field3D<T>& current() const { return current_; }
+
+    /// the buffer holding the solution of the last timestep
+    Field3D<T>& previous() { return previous_; }
+    const Field3D<T>& previous() const { return previous_; }
+
+    /// make the current solution the previous one, the old previous buffer will be overwritten next
+    void swap() noexcept
+    {
+        current_.swap(previous_);
+    }
+
+    /// copy the current buffer into the previous one, required once after the initial conditions have been set
+    void synchronise()
+    {
+        previous_ = current_;
+    }
+
+private:
+    Field3D<T> current_;
+    Field3D<T> previous_;
+};
+
+#endif
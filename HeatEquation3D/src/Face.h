@@ -0,0 +1,244 @@
+/// generic kernels for the six faces of a sub-domain, templated on the DIRECTION the face lies in.
+
+/**
+ * A face is spanned by its two tangential coordinates a < b, e.g. y and z for the LEFT and RIGHT face. The inner loop
+ * always runs over b, which is the unit stride direction for all faces but BACK and FRONT, whose rows are therefore
+ * updated by the row kernel selected in StencilKernels.h. For BACK and FRONT, the inner loop is strided in the field,
+ * but unit stride in the halo buffer.
+ *
+ * The halo received from a neighbor is not copied into the ghost layer of the field any more. Instead, the face update
+ * reads it directly from the receive buffer through a FaceView, which maps the face coordinates (a, b) to a position
+ * in memory with two strides. The same view can also describe a plane of a Field3D, e.g. its ghost layer.
+ */
+
+#ifndef FACE_H
+#define FACE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "StencilKernels.h"
+#include "Threading.h"
+
+/// a strided two-dimensional view of a face, cell (a, b) is at data[offset + a * strideA + b * strideB]
+template<typename floatT>
+struct FaceView
+{
+    const floatT* data;
+    std::ptrdiff_t offset;
+    std::ptrdiff_t strideA;
+    std::ptrdiff_t strideB;
+
+    const floatT& operator()(int a, int b) const { return data[offset + a * strideA + b * strideB]; }
+};
+
+/// the normal and the two tangential coordinates of the face in the given direction
+template<int direction>
+struct FaceAxes
+{
+    static const int normal = direction / 2;
+    static const bool upper = direction % 2 == 1;
+    static const int a = normal == X ? Y : X;
+    static const int b = normal == Z ? Y : Z;
+};
+
+/// distance between neighboring cells of a field in each coordinate direction
+template<typename floatT>
+inline std::ptrdiff_t fieldStride(const Field3D<floatT>& field, int coordinate)
+{
+    return coordinate == X ? field.strideX() : coordinate == Y ? field.strideY() : field.strideZ();
+}
+
+/// view of a halo buffer filled by packFace(...), i.e. holding cells 1 <= a, b <= size - 2 of the face row by row
+template<int direction, typename floatT>
+inline FaceView<floatT> bufferFace(const floatT* buffer, const unsigned size[NUMBER_OF_DIMENSIONS])
+{
+    const std::ptrdiff_t rowLength = static_cast<std::ptrdiff_t>(size[FaceAxes<direction>::b]) - 2;
+    return FaceView<floatT>{ buffer, -rowLength - 1, rowLength, 1 };
+}
+
+/// view of the ghost layer beyond the face in the given direction, e.g. for a halo received in place
+template<int direction, typename floatT>
+inline FaceView<floatT> ghostFace(const Field3D<floatT>& field)
+{
+    typedef FaceAxes<direction> axes;
+    const int plane = axes::upper ? static_cast<int>(field.size(axes::normal)) : -1;
+    return FaceView<floatT>{ field.origin(), plane * fieldStride(field, axes::normal), fieldStride(field, axes::a),
+        fieldStride(field, axes::b) };
+}
+
+/// write the first plane inside the face in the given direction (the one the neighbor needs) into buffer
+template<int direction, typename floatT>
+inline void packFace(const Field3D<floatT>& field, std::vector<floatT>& buffer)
+{
+    typedef FaceAxes<direction> axes;
+    const int sizeA = static_cast<int>(field.size(axes::a));
+    const int sizeB = static_cast<int>(field.size(axes::b));
+    const std::ptrdiff_t strideA = fieldStride(field, axes::a);
+    const std::ptrdiff_t strideB = fieldStride(field, axes::b);
+    const int plane = axes::upper ? static_cast<int>(field.size(axes::normal)) - 2 : 1;
+    const floatT* source = field.origin() + plane * fieldStride(field, axes::normal);
+    floatT* destination = buffer.data();
+
+    HEAT3D_OMP(parallel for schedule(static))
+    for (int a = 1; a < sizeA - 1; ++a) {
+        HEAT3D_OMP(simd)
+        for (int b = 1; b < sizeB - 1; ++b)
+            destination[(a - 1) * (sizeB - 2) + b - 1] = source[a * strideA + b * strideB];
+    }
+}
+
+/// update the face in the given direction with the row kernel of StencilKernels.h, the face must not be BACK or FRONT
+/**
+ * the row kernel reads the neighbors of a cell at fixed distances from it, so the row (a, 1 <= b <= size - 2) of the
+ * face, its four neighbor rows and the row of the halo beyond it are gathered into rows, where the neighbors across the
+ * face are one row and the tangential ones two rows away from the centre row.
+ */
+template<int direction, typename floatT>
+inline void computeFaceRows(const Field3D<floatT>& T0, Field3D<floatT>& T, FaceView<floatT> halo, floatT Dx,
+    floatT Dy, floatT Dz)
+{
+    typedef FaceAxes<direction> axes;
+    const int sizeA = static_cast<int>(T0.size(axes::a));
+    const int sizeB = static_cast<int>(T0.size(axes::b));
+    const std::ptrdiff_t strideA = fieldStride(T0, axes::a);
+    const std::ptrdiff_t strideNormal = fieldStride(T0, axes::normal);
+    const int plane = axes::upper ? static_cast<int>(T0.size(axes::normal)) - 1 : 0;
+    const floatT* c = T0.origin() + plane * strideNormal;
+    floatT* t = T.origin() + plane * strideNormal;
+    const std::ptrdiff_t length = sizeB;
+    const std::ptrdiff_t side = axes::upper ? 1 : -1;
+    const auto update = stencilKernels<floatT>().update;
+
+    HEAT3D_OMP(parallel)
+    {
+        std::vector<floatT> rows(5 * length);
+        floatT* centre = rows.data() + 2 * length;
+
+        HEAT3D_OMP(for schedule(static))
+        for (int a = 1; a < sizeA - 1; ++a) {
+            const floatT* row = c + a * strideA;
+            const floatT* inside = row - side * strideNormal;
+            centre[0] = row[0];
+            centre[sizeB - 1] = row[sizeB - 1];
+            HEAT3D_OMP(simd)
+            for (int b = 1; b < sizeB - 1; ++b) {
+                centre[b] = row[b];
+                centre[b - side * length] = inside[b];
+                centre[b + side * length] = halo(a, b);
+                centre[b - 2 * length] = row[b - strideA];
+                centre[b + 2 * length] = row[b + strideA];
+            }
+            update(centre, t + a * strideA, axes::normal == X ? length : 2 * length,
+                axes::normal == Y ? length : 2 * length, 1, sizeB - 1, Dx, Dy, Dz);
+        }
+    }
+}
+
+/// update the face in the given direction, the cells beyond the face are read from halo
+/**
+ * all faces but BACK and FRONT run over rows in k and are updated by computeFaceRows(...). The rows of BACK and FRONT
+ * are strided in the field and updated here, in the same order of operations as the row kernels, so the result does not
+ * depend on which kernel updated a cell. The neighbor across the face that is not read from halo is loaded from the
+ * field but never used, the compiler removes that load as the direction is known at compile time.
+ */
+template<int direction, typename floatT>
+inline void computeFace(const Field3D<floatT>& T0, Field3D<floatT>& T, FaceView<floatT> halo, floatT Dx, floatT Dy,
+    floatT Dz)
+{
+    typedef FaceAxes<direction> axes;
+    if (axes::b == Z) {
+        computeFaceRows<direction>(T0, T, halo, Dx, Dy, Dz);
+        return;
+    }
+
+    const int sizeA = static_cast<int>(T0.size(axes::a));
+    const int sizeB = static_cast<int>(T0.size(axes::b));
+    const std::ptrdiff_t strideA = fieldStride(T0, axes::a);
+    const std::ptrdiff_t strideB = fieldStride(T0, axes::b);
+    const std::ptrdiff_t strideX = T0.strideX();
+    const std::ptrdiff_t strideY = T0.strideY();
+    const int plane = axes::upper ? static_cast<int>(T0.size(axes::normal)) - 1 : 0;
+    const floatT* c = T0.origin() + plane * fieldStride(T0, axes::normal);
+    floatT* t = T.origin() + plane * fieldStride(T0, axes::normal);
+
+    HEAT3D_OMP(parallel for schedule(static))
+    for (int a = 1; a < sizeA - 1; ++a) {
+        HEAT3D_OMP(simd)
+        for (int b = 1; b < sizeB - 1; ++b) {
+            const std::ptrdiff_t index = a * strideA + b * strideB;
+            floatT neighbor[NUMBER_OF_DIMENSIONS][2] = {
+                { c[index - strideX], c[index + strideX] },
+                { c[index - strideY], c[index + strideY] },
+                { c[index - 1], c[index + 1] }
+            };
+            neighbor[axes::normal][axes::upper ? 1 : 0] = halo(a, b);
+
+            t[index] = c[index] +
+                Dx * (neighbor[X][1] - 2.0 * c[index] + neighbor[X][0]) +
+                Dy * (neighbor[Y][1] - 2.0 * c[index] + neighbor[Y][0]) +
+                Dz * (neighbor[Z][1] - 2.0 * c[index] + neighbor[Z][0]);
+        }
+    }
+}
+
+/// packFace(...) for a direction only known at runtime
+template<typename floatT>
+inline void packFace(int direction, const Field3D<floatT>& field, std::vector<floatT>& buffer)
+{
+    switch (direction) {
+    case LEFT: packFace<LEFT>(field, buffer); break;
+    case RIGHT: packFace<RIGHT>(field, buffer); break;
+    case BOTTOM: packFace<BOTTOM>(field, buffer); break;
+    case TOP: packFace<TOP>(field, buffer); break;
+    case BACK: packFace<BACK>(field, buffer); break;
+    case FRONT: packFace<FRONT>(field, buffer); break;
+    }
+}
+
+/// bufferFace(...) for a direction only known at runtime
+template<typename floatT>
+inline FaceView<floatT> bufferFace(int direction, const floatT* buffer, const unsigned size[NUMBER_OF_DIMENSIONS])
+{
+    switch (direction) {
+    case LEFT: return bufferFace<LEFT>(buffer, size);
+    case RIGHT: return bufferFace<RIGHT>(buffer, size);
+    case BOTTOM: return bufferFace<BOTTOM>(buffer, size);
+    case TOP: return bufferFace<TOP>(buffer, size);
+    case BACK: return bufferFace<BACK>(buffer, size);
+    default: return bufferFace<FRONT>(buffer, size);
+    }
+}
+
+/// ghostFace(...) for a direction only known at runtime
+template<typename floatT>
+inline FaceView<floatT> ghostFace(int direction, const Field3D<floatT>& field)
+{
+    switch (direction) {
+    case LEFT: return ghostFace<LEFT>(field);
+    case RIGHT: return ghostFace<RIGHT>(field);
+    case BOTTOM: return ghostFace<BOTTOM>(field);
+    case TOP: return ghostFace<TOP>(field);
+    case BACK: return ghostFace<BACK>(field);
+    default: return ghostFace<FRONT>(field);
+    }
+}
+
+/// computeFace(...) for a direction only known at runtime, reading the halo through the given view
+template<typename floatT>
+inline void computeFace(int direction, const Field3D<floatT>& T0, Field3D<floatT>& T, FaceView<floatT> halo, floatT Dx,
+    floatT Dy, floatT Dz)
+{
+    switch (direction) {
+    case LEFT: computeFace<LEFT>(T0, T, halo, Dx, Dy, Dz); break;
+    case RIGHT: computeFace<RIGHT>(T0, T, halo, Dx, Dy, Dz); break;
+    case BOTTOM: computeFace<BOTTOM>(T0, T, halo, Dx, Dy, Dz); break;
+    case TOP: computeFace<TOP>(T0, T, halo, Dx, Dy, Dz); break;
+    case BACK: computeFace<BACK>(T0, T, halo, Dx, Dy, Dz); break;
+    case FRONT: computeFace<FRONT>(T0, T, halo, Dx, Dy, Dz); break;
+    }
+}
+
+#endif
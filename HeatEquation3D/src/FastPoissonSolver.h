@@ -0,0 +1,472 @@
+/// direct solver for the steady state with discrete sine transforms (DST) on pencils of the distributed grid.
+
+/**
+ * On the uniform box with Dirichlet faces, the eigenvectors of A (see Laplacian.h) restricted to the unknowns are
+ * products of sines, so A is diagonalised by the DST-I along x, y and z:
+ *
+ * A u = r   <=>   u = S^-1 (S r / lambda),   lambda[kx, ky, kz] = sum over x, y, z of 2 c (1 - cos(pi k / (nodes - 1)))
+ *
+ * with S = Sx Sy Sz, where S applied twice is the identity times (nodes - 1) / 2 in each direction. This solves for the
+ * steady state in O(N^3 log N) operations without any iteration. As the boundary values are given, the solver computes
+ * the residual r = -A T of the current solution, solves A e = r for the correction (which is zero on the boundary) and
+ * adds e to T. In exact arithmetic one correction is enough, solve(...) repeats it until the residual dropped by the
+ * tolerance.
+ *
+ * The sub-domains are blocks of the Cartesian topology, but a sine transform along x needs complete lines in x. For
+ * each direction, the processors along that direction (a communicator from MPI_Cart_sub) exchange their blocks with
+ * MPI_Alltoallv such that each of them holds complete lines, i.e. a pencil, for an equal share of the lines, transform
+ * them and send them back. Each node is counted once (see Laplacian::owned()), the nodes shared with the upper
+ * neighbor are copied from it after the solve.
+ *
+ * The transforms use FFTW (its RODFT00 is the DST-I) if HEAT3D_USE_FFTW is defined, see CMakeLists.txt, and a built-in
+ * mixed radix FFT of the odd extension of each line otherwise.
+ */
+
+#ifndef FASTPOISSONSOLVER_H
+#define FASTPOISSONSOLVER_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#if defined(HEAT3D_USE_FFTW)
+#include <fftw3.h>
+#endif
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "Laplacian.h"
+#include "Threading.h"
+
+/// y[k] = sum over j = 1 ... n of x[j] sin(pi j k / (n + 1)) for k = 1 ... n, the unnormalised DST-I
+template<typename floatT>
+class SineTransform
+{
+public:
+    SineTransform() = default;
+    SineTransform(const SineTransform&) = delete;
+    SineTransform& operator=(const SineTransform&) = delete;
+
+    ~SineTransform()
+    {
+#if defined(HEAT3D_USE_FFTW)
+        if (plan_)
+            fftw_destroy_plan(plan_);
+#endif
+    }
+
+    void init(int length)
+    {
+        length_ = length;
+#if defined(HEAT3D_USE_FFTW)
+        static_assert(std::is_same<floatT, double>::value, "FFTW is only used in double precision");
+        std::vector<double> line(length);
+        plan_ = fftw_plan_r2r_1d(length, line.data(), line.data(), FFTW_RODFT00, FFTW_ESTIMATE | FFTW_UNALIGNED);
+#else
+        /// the odd extension has length 2 (n + 1), which is split into its prime factors
+        const int size = 2 * (length + 1);
+        factors_.clear();
+        for (int remaining = size, p = 2; remaining > 1;) {
+            while (remaining % p != 0)
+                p = p * p > remaining ? remaining : p + 1;
+            factors_.push_back(p);
+            remaining /= p;
+        }
+        const floatT pi = std::acos(floatT(-1.0));
+        twiddle_.resize(size);
+        for (int k = 0; k < size; ++k)
+            twiddle_[k] = std::polar(floatT(1.0), -2.0 * pi * k / size);
+
+        /// position q0 m0 + q1 m1 + ... of the digit reversed input holds input q0 + q1 p0 + q2 p0 p1 + ...
+        permutation_.resize(size);
+        for (int position = 0; position < size; ++position) {
+            int remaining = position, index = 0, stride = 1, m = size;
+            for (const int p : factors_) {
+                m /= p;
+                index += remaining / m * stride;
+                remaining %= m;
+                stride *= p;
+            }
+            permutation_[position] = index;
+        }
+#endif
+    }
+
+    int length() const { return length_; }
+
+    /// transform line in place, scratch holds the working memory of one thread
+    void apply(floatT* line, std::vector<std::complex<floatT>>& scratch) const
+    {
+#if defined(HEAT3D_USE_FFTW)
+        (void)scratch;
+        fftw_execute_r2r(plan_, line, line);
+        for (int k = 0; k < length_; ++k)
+            line[k] *= 0.5;
+#else
+        const int size = 2 * (length_ + 1);
+        scratch.resize(2 * size);
+        std::complex<floatT>* spectrum = scratch.data();
+        for (int position = 0; position < size; ++position) {
+            /// the odd extension 0, x[1], ..., x[n], 0, -x[n], ..., -x[1] in digit reversed order
+            const int j = permutation_[position];
+            spectrum[position] = j == 0 || j == length_ + 1 ? 0.0 : j <= length_ ? line[j - 1] : -line[size - j - 1];
+        }
+        fft(spectrum, spectrum + size);
+
+        /// the spectrum of the odd extension is -2i times the sine transform
+        for (int k = 1; k <= length_; ++k)
+            line[k - 1] = -0.5 * spectrum[k].imag();
+#endif
+    }
+
+private:
+#if !defined(HEAT3D_USE_FFTW)
+    /// decimation in time on the digit reversed data, from the shortest sub-transforms to the complete one
+    void fft(std::complex<floatT>* data, std::complex<floatT>* work) const
+    {
+        const int size = static_cast<int>(twiddle_.size());
+        const std::complex<floatT>* twiddle = twiddle_.data();
+        int m = 1;
+        for (int f = static_cast<int>(factors_.size()) - 1; f >= 0; --f) {
+            /// size / (m p) sub-transforms of length m p, each from p sub-transforms of length m
+            const int p = factors_[f];
+            const int stride = size / (m * p);
+            for (int block = 0; block < size; block += m * p) {
+                std::complex<floatT>* out = data + block;
+                if (p == 2) {
+                    /// radix 2, the common case, written out: the complex product of std::complex checks for infinities
+                    for (int u = 0; u < m; ++u) {
+                        const std::complex<floatT> w = twiddle[stride * u];
+                        const std::complex<floatT> a = out[u], b = out[u + m];
+                        const std::complex<floatT> wb(w.real() * b.real() - w.imag() * b.imag(),
+                            w.real() * b.imag() + w.imag() * b.real());
+                        out[u] = a + wb;
+                        out[u + m] = a - wb;
+                    }
+                    continue;
+                }
+                for (int u = 0; u < m; ++u) {
+                    for (int q = 0; q < p; ++q)
+                        work[q] = out[u + q * m];
+                    for (int q = 0; q < p; ++q) {
+                        const int k = u + q * m;
+                        const int step = stride * k % size;
+                        std::complex<floatT> sum = work[0];
+                        for (int r = 1, index = step; r < p; ++r, index = index + step < size ? index + step :
+                                index + step - size)
+                            sum += work[r] * twiddle[index];
+                        out[k] = sum;
+                    }
+                }
+            }
+            m *= p;
+        }
+    }
+
+    std::vector<int> factors_;
+    std::vector<int> permutation_;
+    std::vector<std::complex<floatT>> twiddle_;
+#else
+    fftw_plan plan_ = nullptr;
+#endif
+    int length_ = 0;
+};
+
+template<typename floatT>
+class FastPoissonSolver
+{
+public:
+    /// comm has to be the Cartesian communicator, the other arguments as in main()
+    FastPoissonSolver(MPI_Comm comm, const int dims[NUMBER_OF_DIMENSIONS], const int coords[NUMBER_OF_DIMENSIONS],
+        const int neighbors[NUMBER_OF_DIMENSIONS * 2], const unsigned chunk[NUMBER_OF_DIMENSIONS],
+        const floatT spacing[NUMBER_OF_DIMENSIONS])
+        : op_(comm, neighbors, chunk, spacing)
+    {
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            neighbors_[2 * coordinate] = neighbors[2 * coordinate];
+            neighbors_[2 * coordinate + 1] = neighbors[2 * coordinate + 1];
+
+            int remain[NUMBER_OF_DIMENSIONS] = { 0, 0, 0 };
+            remain[coordinate] = 1;
+            MPI_Cart_sub(comm, remain, &line_[coordinate]);
+            rank_[coordinate] = coords[coordinate];
+
+            /// processor r owns the interior nodes [start[r], start[r] + count[r]) of each line
+            const int n = static_cast<int>(chunk[coordinate]);
+            count_[coordinate].resize(dims[coordinate]);
+            start_[coordinate].resize(dims[coordinate]);
+            for (int r = 0; r < dims[coordinate]; ++r) {
+                count_[coordinate][r] = r == 0 ? n - 2 : n - 1;
+                start_[coordinate][r] = r == 0 ? 0 : r * (n - 1) - 1;
+            }
+            owned_[coordinate] = count_[coordinate][coords[coordinate]];
+            interior_[coordinate] = dims[coordinate] * (n - 1) - 1;
+            sine_[coordinate].init(interior_[coordinate]);
+        }
+
+        block_.resize(static_cast<std::size_t>(owned_[X]) * owned_[Y] * owned_[Z]);
+        correction_.resize(chunk[X], chunk[Y], chunk[Z]);
+        product_.resize(chunk[X], chunk[Y], chunk[Z]);
+
+        /// the eigenvalues of A for the wave numbers of the owned nodes, and the normalisation of both transforms
+        const floatT pi = std::acos(floatT(-1.0));
+        floatT scale = 1.0;
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            const int size = interior_[coordinate] + 1;
+            eigenvalues_[coordinate].resize(owned_[coordinate]);
+            for (int i = 0; i < owned_[coordinate]; ++i) {
+                const int waveNumber = start_[coordinate][rank_[coordinate]] + i + 1;
+                eigenvalues_[coordinate][i] = 2.0 * op_.coefficient(coordinate) * (1.0 - std::cos(pi * waveNumber / size));
+            }
+            scale *= 2.0 / size;
+        }
+        scale_ = scale;
+    }
+
+    /// the communicators along each direction are freed unless MPI has already been finalised (end of main())
+    ~FastPoissonSolver()
+    {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (!finalized)
+            for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+                MPI_Comm_free(&line_[coordinate]);
+    }
+
+    FastPoissonSolver(const FastPoissonSolver&) = delete;
+    FastPoissonSolver& operator=(const FastPoissonSolver&) = delete;
+
+    /// the solution, holding the Dirichlet values on the boundary
+    Field3D<floatT>& solution() { return x_; }
+
+    /// correct the solution until the L2-norm of the residual dropped by tolerance or maxSolves were done
+    /**
+     * returns the number of direct solves, solution() has to be swapped in before.
+     */
+    unsigned solve(floatT tolerance, unsigned maxSolves)
+    {
+        unsigned solves = 0;
+        initialResidual_ = residual_ = computeResidual();
+        while (solves < maxSolves && residual_ > tolerance * initialResidual_) {
+            transformAll();
+            const floatT* ex = eigenvalues_[X].data();
+            const floatT* ey = eigenvalues_[Y].data();
+            const floatT* ez = eigenvalues_[Z].data();
+            const int ny = owned_[Y], nz = owned_[Z];
+            const floatT scale = scale_;
+            floatT* block = block_.data();
+
+            HEAT3D_OMP(parallel for collapse(2) schedule(static))
+            for (int i = 0; i < owned_[X]; ++i)
+                for (int j = 0; j < ny; ++j) {
+                    floatT* row = block + (static_cast<std::size_t>(i) * ny + j) * nz;
+                    for (int k = 0; k < nz; ++k)
+                        row[k] *= scale / (ex[i] + ey[j] + ez[k]);
+                }
+
+            transformAll();
+            correct();
+            residual_ = computeResidual();
+            ++solves;
+        }
+        return solves;
+    }
+
+    /// L2-norm of the residual before the first and after the last solve
+    floatT initialResidual() const { return initialResidual_; }
+    floatT residual() const { return residual_; }
+
+    /// the number of interior nodes per line in each direction, i.e. the length of the transforms
+    int transformLength(int coordinate) const { return interior_[coordinate]; }
+
+private:
+    /// r = -A x on the owned nodes into block_, returns the L2-norm of r over all processors
+    floatT computeResidual()
+    {
+        op_.exchange(x_);
+        op_.apply(x_, product_);
+        const NodeRange& o = op_.owned();
+        const int ny = owned_[Y], nz = owned_[Z];
+        floatT* block = block_.data();
+        floatT sumOfSquares = 0.0;
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static) reduction(+:sumOfSquares))
+        for (int i = 0; i < owned_[X]; ++i)
+            for (int j = 0; j < ny; ++j) {
+                floatT* row = block + (static_cast<std::size_t>(i) * ny + j) * nz;
+                const floatT* product = &product_(o.lo[X] + i, o.lo[Y] + j, o.lo[Z]);
+                for (int k = 0; k < nz; ++k) {
+                    row[k] = -product[k];
+                    sumOfSquares += row[k] * row[k];
+                }
+            }
+        op_.sum(&sumOfSquares, 1);
+        return std::sqrt(sumOfSquares);
+    }
+
+    /// add the correction in block_ to the solution, including the nodes shared with the upper neighbors
+    void correct()
+    {
+        const NodeRange& o = op_.owned();
+        const int ny = owned_[Y], nz = owned_[Z];
+        const floatT* block = block_.data();
+        Field3D<floatT>& e = correction_;
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = 0; i < owned_[X]; ++i)
+            for (int j = 0; j < ny; ++j)
+                std::copy(block + (static_cast<std::size_t>(i) * ny + j) * nz,
+                    block + (static_cast<std::size_t>(i) * ny + j + 1) * nz, &e(o.lo[X] + i, o.lo[Y] + j, o.lo[Z]));
+
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+            shareUpperPlane(coordinate);
+
+        op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+            floatT* x = &x_(i, j, 0);
+            const floatT* c = &e(i, j, 0);
+            HEAT3D_OMP(simd)
+            for (int k = kBegin; k < kEnd; ++k)
+                x[k] += c[k];
+        });
+    }
+
+    /// copy plane 0 of the upper neighbor (which owns it) into plane size - 1, over the whole extent of the other two
+    /// directions, such that after all three directions the edges and corners are up to date as well
+    void shareUpperPlane(int coordinate)
+    {
+        Field3D<floatT>& e = correction_;
+        const int a = coordinate == X ? Y : X;
+        const int b = coordinate == Z ? Y : Z;
+        const int sizeA = static_cast<int>(e.size(a)), sizeB = static_cast<int>(e.size(b));
+        const int last = static_cast<int>(e.size(coordinate)) - 1;
+        std::vector<floatT> send(static_cast<std::size_t>(sizeA) * sizeB), receive(send.size());
+
+        auto node = [&](int plane, int p, int q) -> floatT& {
+            int index[NUMBER_OF_DIMENSIONS];
+            index[coordinate] = plane;
+            index[a] = p;
+            index[b] = q;
+            return e(index[X], index[Y], index[Z]);
+        };
+
+        if (neighbors_[2 * coordinate] != MPI_PROC_NULL)
+            for (int p = 0; p < sizeA; ++p)
+                for (int q = 0; q < sizeB; ++q)
+                    send[static_cast<std::size_t>(p) * sizeB + q] = node(0, p, q);
+        MPI_Sendrecv(send.data(), static_cast<int>(send.size()), mpiDatatype<floatT>(), neighbors_[2 * coordinate], 400,
+            receive.data(), static_cast<int>(receive.size()), mpiDatatype<floatT>(), neighbors_[2 * coordinate + 1], 400,
+            op_.comm(), MPI_STATUS_IGNORE);
+        if (neighbors_[2 * coordinate + 1] != MPI_PROC_NULL)
+            for (int p = 0; p < sizeA; ++p)
+                for (int q = 0; q < sizeB; ++q)
+                    node(last, p, q) = receive[static_cast<std::size_t>(p) * sizeB + q];
+    }
+
+    /// apply the sine transform along x, y and z to block_
+    void transformAll()
+    {
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+            transform(coordinate);
+    }
+
+    /// gather complete lines in one direction, transform them and scatter them back into block_
+    /**
+     * the lines through the owned block (indexed by the two other directions) are split evenly among the processors
+     * along the direction, each of which receives its share of lines from all of them.
+     */
+    void transform(int coordinate)
+    {
+        const int processors = static_cast<int>(count_[coordinate].size());
+        const int a = coordinate == X ? Y : X;
+        const int b = coordinate == Z ? Y : Z;
+        const int lines = owned_[a] * owned_[b];
+        const int length = interior_[coordinate];
+        const int segment = owned_[coordinate];
+        auto firstLine = [&](int r) { return static_cast<int>(static_cast<long long>(lines) * r / processors); };
+        const int myLines = firstLine(rank_[coordinate] + 1) - firstLine(rank_[coordinate]);
+
+        /// stride of the owned block in each direction, k is contiguous
+        std::ptrdiff_t stride[NUMBER_OF_DIMENSIONS];
+        stride[Z] = 1;
+        stride[Y] = owned_[Z];
+        stride[X] = static_cast<std::ptrdiff_t>(owned_[Y]) * owned_[Z];
+        auto lineStart = [&](int line) { return (line / owned_[b]) * stride[a] + (line % owned_[b]) * stride[b]; };
+
+        std::vector<int> sendCounts(processors), sendOffsets(processors), receiveCounts(processors),
+            receiveOffsets(processors);
+        for (int r = 0; r < processors; ++r) {
+            sendCounts[r] = (firstLine(r + 1) - firstLine(r)) * segment;
+            sendOffsets[r] = firstLine(r) * segment;
+            receiveCounts[r] = myLines * count_[coordinate][r];
+            receiveOffsets[r] = r == 0 ? 0 : receiveOffsets[r - 1] + receiveCounts[r - 1];
+        }
+
+        /// lines are sent in order, each with the owned segment of this processor
+        sendBuffer_.resize(static_cast<std::size_t>(lines) * segment);
+        HEAT3D_OMP(parallel for schedule(static))
+        for (int line = 0; line < lines; ++line) {
+            const floatT* in = block_.data() + lineStart(line);
+            floatT* out = sendBuffer_.data() + static_cast<std::size_t>(line) * segment;
+            for (int i = 0; i < segment; ++i)
+                out[i] = in[i * stride[coordinate]];
+        }
+
+        receiveBuffer_.resize(static_cast<std::size_t>(myLines) * length);
+        MPI_Alltoallv(sendBuffer_.data(), sendCounts.data(), sendOffsets.data(), mpiDatatype<floatT>(),
+            receiveBuffer_.data(), receiveCounts.data(), receiveOffsets.data(), mpiDatatype<floatT>(),
+            line_[coordinate]);
+
+        /// assemble the complete lines from the segments of all processors, transform them and split them again
+        pencil_.resize(static_cast<std::size_t>(myLines) * length);
+        const SineTransform<floatT>& sine = sine_[coordinate];
+        HEAT3D_OMP(parallel)
+        {
+            std::vector<std::complex<floatT>> scratch;
+            HEAT3D_OMP(for schedule(static))
+            for (int line = 0; line < myLines; ++line) {
+                floatT* pencil = pencil_.data() + static_cast<std::size_t>(line) * length;
+                for (int r = 0; r < processors; ++r)
+                    std::copy(receiveBuffer_.data() + receiveOffsets[r] + line * count_[coordinate][r],
+                        receiveBuffer_.data() + receiveOffsets[r] + (line + 1) * count_[coordinate][r],
+                        pencil + start_[coordinate][r]);
+                sine.apply(pencil, scratch);
+                for (int r = 0; r < processors; ++r)
+                    std::copy(pencil + start_[coordinate][r], pencil + start_[coordinate][r] + count_[coordinate][r],
+                        receiveBuffer_.data() + receiveOffsets[r] + line * count_[coordinate][r]);
+            }
+        }
+
+        MPI_Alltoallv(receiveBuffer_.data(), receiveCounts.data(), receiveOffsets.data(), mpiDatatype<floatT>(),
+            sendBuffer_.data(), sendCounts.data(), sendOffsets.data(), mpiDatatype<floatT>(), line_[coordinate]);
+
+        HEAT3D_OMP(parallel for schedule(static))
+        for (int line = 0; line < lines; ++line) {
+            floatT* out = block_.data() + lineStart(line);
+            const floatT* in = sendBuffer_.data() + static_cast<std::size_t>(line) * segment;
+            for (int i = 0; i < segment; ++i)
+                out[i * stride[coordinate]] = in[i];
+        }
+    }
+
+    Laplacian<floatT> op_;
+    int neighbors_[NUMBER_OF_DIMENSIONS * 2];
+    MPI_Comm line_[NUMBER_OF_DIMENSIONS];
+    int rank_[NUMBER_OF_DIMENSIONS];
+    std::vector<int> count_[NUMBER_OF_DIMENSIONS];
+    std::vector<int> start_[NUMBER_OF_DIMENSIONS];
+    int owned_[NUMBER_OF_DIMENSIONS];
+    int interior_[NUMBER_OF_DIMENSIONS];
+    SineTransform<floatT> sine_[NUMBER_OF_DIMENSIONS];
+    std::vector<floatT> eigenvalues_[NUMBER_OF_DIMENSIONS];
+    floatT scale_;
+    std::vector<floatT> block_, sendBuffer_, receiveBuffer_, pencil_;
+    Field3D<floatT> x_, correction_, product_;
+    floatT initialResidual_ = 0.0;
+    floatT residual_ = 0.0;
+};
+
+#endif
@@ -0,0 +1,192 @@
+/// contiguous, halo-padded storage for the solution on a single sub-domain.
+
+/**
+ * The solution used to live in std::vector<std::vector<std::vector<floatT>>>, which scatters every row of the domain
+ * across the heap and forces two pointer dereferences per access. Field3D stores the whole sub-domain (including its
+ * ghost layers) in a single 64-byte aligned block of memory with explicit strides, i.e. element (i, j, k) is found at
+ *
+ * origin[i * strideX + j * strideY + k]
+ *
+ * k is always the contiguous (unit stride) direction. Valid indices run from -ghost to size + ghost - 1 in each
+ * direction, so that index -1 addresses the first ghost layer in front of the sub-domain. Each row is padded such
+ * that element (i, j, 0) is always aligned to the 64 byte boundary, which allows the compiler to vectorise along k.
+ */
+
+#ifndef FIELD3D_H
+#define FIELD3D_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "Threading.h"
+
+template<typename T>
+class Field3D
+{
+public:
+    /// alignment (in bytes) of the first interior element of each row
+    static constexpr std::size_t alignment = 64;
+
+    Field3D() = default;
+
+    Field3D(unsigned sizeX, unsigned sizeY, unsigned sizeZ, unsigned ghost = 1)
+    {
+        resize(sizeX, sizeY, sizeZ, ghost);
+    }
+
+    Field3D(const Field3D& other)
+    {
+        *this = other;
+    }
+
+    Field3D(Field3D&& other) noexcept
+    {
+        swap(other);
+    }
+
+    Field3D& operator=(const Field3D& other)
+    {
+        if (this != &other) {
+            /// the storage is kept if the shape does not change, so its address stays valid (e.g. for persistent
+            /// requests)
+            if (!storage_ || size_[0] != other.size_[0] || size_[1] != other.size_[1] || size_[2] != other.size_[2] ||
+                ghost_ != other.ghost_)
+                resize(other.size_[0], other.size_[1], other.size_[2], other.ghost_);
+            std::copy(other.data(), other.data() + other.allocatedSize(), data());
+        }
+        return *this;
+    }
+
+    Field3D& operator=(Field3D&& other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    /// (re-)allocate storage for sizeX * sizeY * sizeZ cells surrounded by ghost layers of the given width
+    void resize(unsigned sizeX, unsigned sizeY, unsigned sizeZ, unsigned ghost = 1)
+    {
+        const std::size_t elementsPerLine = alignment / sizeof(T) > 0 ? alignment / sizeof(T) : 1;
+
+        size_[0] = sizeX;
+        size_[1] = sizeY;
+        size_[2] = sizeZ;
+        ghost_ = ghost;
+
+        /// the leading padding in k puts element k = 0 on a cache line boundary, the trailing one rounds up the row
+        offsetZ_ = roundUp(ghost, elementsPerLine);
+        strideY_ = static_cast<std::ptrdiff_t>(roundUp(offsetZ_ + sizeZ + ghost, elementsPerLine));
+        strideX_ = strideY_ * static_cast<std::ptrdiff_t>(sizeY + 2 * ghost);
+        allocated_ = static_cast<std::size_t>(strideX_) * (sizeX + 2 * ghost);
+
+        storage_.reset(new T[allocated_ + elementsPerLine]);
+        auto address = reinterpret_cast<std::uintptr_t>(storage_.get());
+        auto misalignment = address % alignment;
+        data_ = storage_.get() + (misalignment == 0 ? 0 : (alignment - misalignment) / sizeof(T));
+        origin_ = data_ + ghost_ * strideX_ + ghost_ * strideY_ + offsetZ_;
+
+        /// the first touch places each plane in the NUMA domain of the thread that works on it later (see Threading.h)
+        const long planes = static_cast<long>(sizeX + 2 * ghost);
+        T* const data = data_;
+        const std::ptrdiff_t strideX = strideX_;
+        HEAT3D_OMP(parallel for schedule(static))
+        for (long plane = 0; plane < planes; ++plane)
+            std::fill(data + plane * strideX, data + (plane + 1) * strideX, T(0));
+    }
+
+    T& operator()(int i, int j, int k)
+    {
+#if defined(USE_DEBUG)
+        assert(inRange(i, j, k) && "Field3D index out of range!");
+#endif
+        return origin_[i * strideX_ + j * strideY_ + k];
+    }
+
+    const T& operator()(int i, int j, int k) const
+    {
+#if defined(USE_DEBUG)
+        assert(inRange(i, j, k) && "Field3D index out of range!");
+#endif
+        return origin_[i * strideX_ + j * strideY_ + k];
+    }
+
+    /// set every cell, including ghost layers and padding, to the given value
+    void fill(const T& value)
+    {
+        std::fill(data_, data_ + allocated_, value);
+    }
+
+    /// O(1) exchange of the underlying storage, no data is copied
+    void swap(Field3D& other) noexcept
+    {
+        std::swap(size_, other.size_);
+        std::swap(ghost_, other.ghost_);
+        std::swap(offsetZ_, other.offsetZ_);
+        std::swap(strideX_, other.strideX_);
+        std::swap(strideY_, other.strideY_);
+        std::swap(allocated_, other.allocated_);
+        std::swap(storage_, other.storage_);
+        std::swap(data_, other.data_);
+        std::swap(origin_, other.origin_);
+    }
+
+    /// number of cells owned by this sub-domain in the given direction, excluding ghost layers
+    unsigned size(unsigned direction) const { return size_[direction]; }
+
+    /// width of the ghost layer on each side of the sub-domain
+    unsigned ghost() const { return ghost_; }
+
+    std::ptrdiff_t strideX() const { return strideX_; }
+    std::ptrdiff_t strideY() const { return strideY_; }
+    std::ptrdiff_t strideZ() const { return 1; }
+
+    /// start of the allocated block, i.e. the first ghost cell including padding
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+
+    /// pointer to cell (0, 0, 0), the first cell owned by this sub-domain
+    T* origin() { return origin_; }
+    const T* origin() const { return origin_; }
+
+    /// offset of cell (0, 0, 0) relative to data()
+    std::ptrdiff_t originOffset() const { return origin_ - data_; }
+
+    /// number of elements reachable through data(), including ghost layers and padding
+    std::size_t allocatedSize() const { return allocated_; }
+
+private:
+    static std::size_t roundUp(std::size_t value, std::size_t multiple)
+    {
+        return ((value + multiple - 1) / multiple) * multiple;
+    }
+
+    bool inRange(int i, int j, int k) const
+    {
+        const int g = static_cast<int>(ghost_);
+        return i >= -g && i < static_cast<int>(size_[0]) + g &&
+            j >= -g && j < static_cast<int>(size_[1]) + g &&
+            k >= -g && k < static_cast<int>(size_[2]) + g;
+    }
+
+    unsigned size_[3] = { 0, 0, 0 };
+    unsigned ghost_ = 0;
+    std::size_t offsetZ_ = 0;
+    std::ptrdiff_t strideX_ = 0;
+    std::ptrdiff_t strideY_ = 0;
+    std::size_t allocated_ = 0;
+    std::unique_ptr<T[]> storage_;
+    T* data_ = nullptr;
+    T* origin_ = nullptr;
+};
+
+template<typename T>
+void swap(Field3D<T>& a, Field3D<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+#endif
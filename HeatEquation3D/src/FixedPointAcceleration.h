@@ -0,0 +1,243 @@
+/// Anderson mixing or Aitken extrapolation of the explicit time loop, seen as a fixed-point iteration.
+
+/**
+ * Towards the steady state, the time loop iterates T = E(T) with the explicit step E. Every interval timesteps, the
+ * iterate g = E^interval(x) is compared with the iterate x it started from, f = g - x, and replaced by
+ *
+ * x' = g - sum over j of gamma[j] dG[j],   gamma = argmin || f - sum over j of gamma[j] dF[j] ||
+ *
+ * where dF and dG hold the differences of the last window values of f and g (Anderson mixing, Walker and Ni, 2011).
+ * For the linear explicit step, this is GMRES on (I - E^interval) with a restart window, while the explicit kernel
+ * itself is unchanged. Aitken extrapolation is the same with a window of one (the vector form of Irons and Tuck),
+ * restarted after each extrapolation, i.e. x' = g - gamma dG from three successive iterates.
+ *
+ * The least squares problem is solved by its normal equations, the Gram matrix of dF is kept from one extrapolation to
+ * the next, so only the dot products of the newest column and of f are computed, fused into a single global
+ * reduction. If the Gram matrix is numerically singular, the window is restarted. Each node of the planes shared by
+ * neighbors is counted by one of them only, the combination is applied to all nodes, so the shared nodes stay
+ * identical. The boundary values do not change, as f and all differences vanish there.
+ *
+ * Besides T and T0, 2 window + 3 fields are needed.
+ */
+
+#ifndef FIXEDPOINTACCELERATION_H
+#define FIXEDPOINTACCELERATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "Threading.h"
+
+template<typename floatT>
+class FixedPointAcceleration
+{
+public:
+    enum Method { ANDERSON, AITKEN };
+
+    /**
+     * neighbors and chunk as in main(), window is the number of differences kept (one for Aitken) and interval the
+     * number of timesteps between two extrapolations.
+     */
+    FixedPointAcceleration(Method method, MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2],
+        const unsigned chunk[NUMBER_OF_DIMENSIONS], int window, unsigned interval)
+        : method_(method), comm_(comm), window_(method == AITKEN ? 1 : std::max(1, window)),
+          interval_(std::max(1u, interval)), x_(chunk[X], chunk[Y], chunk[Z]), fPrevious_(x_), gPrevious_(x_),
+          dF_(window_, x_), dG_(window_, x_), gram_(window_ * window_, 0.0)
+    {
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            const int size = static_cast<int>(chunk[coordinate]);
+            counted_[coordinate] = neighbors[2 * coordinate + 1] != MPI_PROC_NULL ? size - 1 : size;
+            size_[coordinate] = size;
+        }
+    }
+
+    /// called with the new iterate T after timestep time, replaces T by the extrapolation every interval timesteps
+    /**
+     * returns true if T was replaced.
+     */
+    bool update(unsigned time, Field3D<floatT>& T)
+    {
+        if ((time + 1) % interval_ != 0)
+            return false;
+
+        if (samples_ == 0) {
+            x_ = T;
+            ++samples_;
+            return false;
+        }
+
+        /// f = g - x, the differences of f and g to the previous sample go into the next column of the window
+        const bool difference = samples_ > 1;
+        const int column = columns_ < window_ ? columns_ : oldest_;
+        Field3D<floatT>& dF = dF_[column];
+        Field3D<floatT>& dG = dG_[column];
+        forEachRow([&](int i, int j) {
+            const floatT* g = &T(i, j, 0);
+            const floatT* x = &x_(i, j, 0);
+            floatT* fPrevious = &fPrevious_(i, j, 0);
+            floatT* gPrevious = &gPrevious_(i, j, 0);
+            floatT* df = &dF(i, j, 0);
+            floatT* dg = &dG(i, j, 0);
+            HEAT3D_OMP(simd)
+            for (int k = 0; k < size_[Z]; ++k) {
+                const floatT f = g[k] - x[k];
+                df[k] = f - fPrevious[k];
+                dg[k] = g[k] - gPrevious[k];
+                fPrevious[k] = f;
+                gPrevious[k] = g[k];
+            }
+        });
+        ++samples_;
+
+        if (!difference) {
+            x_ = T;
+            return false;
+        }
+        if (columns_ < window_)
+            ++columns_;
+        else
+            oldest_ = (oldest_ + 1) % window_;
+
+        /// the new row of the Gram matrix and dF^T f, reduced together
+        std::vector<floatT> dots(2 * columns_, 0.0);
+        localDots(dF, dots.data());
+        MPI_Request request;
+        MPI_Iallreduce(MPI_IN_PLACE, dots.data(), static_cast<int>(dots.size()), mpiDatatype<floatT>(), MPI_SUM, comm_,
+            &request);
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        for (int j = 0; j < columns_; ++j)
+            gram_[column * window_ + j] = gram_[j * window_ + column] = dots[j];
+
+        std::vector<floatT> gamma(dots.begin() + columns_, dots.end());
+        if (!solveGram(gamma)) {
+            restart(T);
+            return false;
+        }
+
+        /// x' = g - dG gamma
+        forEachRow([&](int i, int j) {
+            floatT* t = &T(i, j, 0);
+            for (int c = 0; c < columns_; ++c) {
+                const floatT* dg = &dG_[c](i, j, 0);
+                const floatT weight = gamma[c];
+                HEAT3D_OMP(simd)
+                for (int k = 0; k < size_[Z]; ++k)
+                    t[k] -= weight * dg[k];
+            }
+        });
+        ++extrapolations_;
+
+        if (method_ == AITKEN)
+            restart(T);
+        else
+            x_ = T;
+        return true;
+    }
+
+    const char* name() const { return method_ == ANDERSON ? "Anderson mixing" : "Aitken extrapolation"; }
+    int window() const { return window_; }
+    unsigned interval() const { return interval_; }
+
+    /// the number of extrapolations done
+    unsigned extrapolations() const { return extrapolations_; }
+
+private:
+    /// kernel(i, j) for all rows of local nodes, in parallel
+    template<typename Kernel>
+    void forEachRow(Kernel kernel) const
+    {
+        const int sizeX = size_[X], sizeY = size_[Y];
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = 0; i < sizeX; ++i)
+            for (int j = 0; j < sizeY; ++j)
+                kernel(i, j);
+    }
+
+    /// the contributions of this processor to the dot products of dF with all columns and of all columns with f
+    /**
+     * in a single pass over the fields, each shared node is counted once.
+     */
+    void localDots(const Field3D<floatT>& dF, floatT* dots) const
+    {
+        const int sizeX = counted_[X], sizeY = counted_[Y], sizeZ = counted_[Z];
+        const int columns = columns_;
+        const Field3D<floatT>& f = fPrevious_;
+        HEAT3D_OMP(parallel for collapse(2) schedule(static) reduction(+:dots[:2 * columns]))
+        for (int i = 0; i < sizeX; ++i)
+            for (int j = 0; j < sizeY; ++j) {
+                const floatT* df = &dF(i, j, 0);
+                const floatT* rowF = &f(i, j, 0);
+                for (int c = 0; c < columns; ++c) {
+                    const floatT* column = &dF_[c](i, j, 0);
+                    floatT withNew = 0.0, withF = 0.0;
+                    HEAT3D_OMP(simd reduction(+:withNew, withF))
+                    for (int k = 0; k < sizeZ; ++k) {
+                        withNew += df[k] * column[k];
+                        withF += column[k] * rowF[k];
+                    }
+                    dots[c] += withNew;
+                    dots[columns + c] += withF;
+                }
+            }
+    }
+
+    /// solve the normal equations gram gamma = rhs in place by Cholesky, false if gram is numerically singular
+    bool solveGram(std::vector<floatT>& gamma) const
+    {
+        const int n = columns_;
+        std::vector<floatT> l(n * n, 0.0);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j <= i; ++j) {
+                floatT sum = gram_[i * window_ + j];
+                for (int k = 0; k < j; ++k)
+                    sum -= l[i * n + k] * l[j * n + k];
+                if (i == j) {
+                    if (!(sum > 1.0e-14 * gram_[i * window_ + i]))
+                        return false;
+                    l[i * n + i] = std::sqrt(sum);
+                }
+                else
+                    l[i * n + j] = sum / l[j * n + j];
+            }
+        for (int i = 0; i < n; ++i) {
+            for (int k = 0; k < i; ++k)
+                gamma[i] -= l[i * n + k] * gamma[k];
+            gamma[i] /= l[i * n + i];
+        }
+        for (int i = n - 1; i >= 0; --i) {
+            for (int k = i + 1; k < n; ++k)
+                gamma[i] -= l[k * n + i] * gamma[k];
+            gamma[i] /= l[i * n + i];
+        }
+        return true;
+    }
+
+    /// drop the window, the next extrapolation needs two new samples, the first of which is T
+    void restart(const Field3D<floatT>& T)
+    {
+        columns_ = 0;
+        oldest_ = 0;
+        samples_ = 1;
+        x_ = T;
+    }
+
+    Method method_;
+    MPI_Comm comm_;
+    int window_;
+    unsigned interval_;
+    int size_[NUMBER_OF_DIMENSIONS];
+    int counted_[NUMBER_OF_DIMENSIONS];
+    Field3D<floatT> x_, fPrevious_, gPrevious_;
+    std::vector<Field3D<floatT>> dF_, dG_;
+    std::vector<floatT> gram_;
+    int columns_ = 0;
+    int oldest_ = 0;
+    unsigned samples_ = 0;
+    unsigned extrapolations_ = 0;
+};
+
+#endif
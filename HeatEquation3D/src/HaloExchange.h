@@ -0,0 +1,441 @@
+/// the halo exchange of the explicit timestep with the six face neighbors, set up once and restarted every timestep.
+
+/**
+ * The sends and receives of the halo use the same buffers, counts, neighbors and tags in every timestep. Instead of
+ * creating them anew with MPI_Isend and MPI_Irecv each time, they are set up once as persistent requests, so a timestep
+ * only starts and completes them and MPI can skip the matching setup it would otherwise repeat per message. This pays
+ * off for small sub-domains, where the messages are short and their setup is a noticeable part of their cost.
+ *
+ * With an MPI 4 library, the sends and receives can be partitioned instead (MPI_Psend_init and MPI_Precv_init). All
+ * requests are started before the faces are packed, and each face is marked ready as soon as it is packed, so it is on
+ * its way while the next face is being packed. As only the master thread calls MPI (see Threading.h), a face is one
+ * partition.
+ *
+ * Without packing at all, the DATATYPE method describes each face in the field by a derived datatype (two nested
+ * strided vectors, as only the faces normal to x are contiguous in their rows). MPI sends directly from the first plane
+ * inside the face of T0 and receives into the ghost layer of T, which the face update then reads in place. As the
+ * requests are bound to the memory of both fields, one set of requests is kept for each pair of fields seen so far,
+ * i.e. two for the DoubleBuffer of the time loop and up to twenty with the stages of the super-time-stepping.
+ *
+ * Instead of twelve point-to-point messages, the NEIGHBORHOOD method issues a single MPI_Ineighbor_alltoallw on the
+ * cartesian communicator, whose neighbors are ordered like the directions (lower, then upper side of x, y and z), and
+ * leaves the scheduling of the messages to the library. The packed buffers are not contiguous, so they are passed by
+ * their absolute address relative to MPI_BOTTOM. All halos arrive together once the collective completes.
+ *
+ * With the ONE_SIDED method, each rank exposes its halo in an MPI window and the neighbors write their faces into it
+ * with MPI_Put, so no receive has to be matched. As the halo is read from the receive buffers instead of the ghost
+ * layers of the field (see Face.h), the window holds one such buffer per direction, allocated by MPI so it can be
+ * registered with the network. The epochs are synchronised with post-start-complete-wait among the face neighbors
+ * only: a rank posts its window before packing, which allows the neighbors to put, and completes its own puts after
+ * the interior. Its halo has arrived once the wait for its window returns, again for all faces at once.
+ *
+ * The receives are started before the faces are packed, so a message arriving early finds its buffer. The faces can
+ * then be processed in the order in which their halo arrives, see arrived() and next().
+ */
+
+#ifndef HALOEXCHANGE_H
+#define HALOEXCHANGE_H
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Face.h"
+#include "Field3D.h"
+
+template<typename floatT>
+class HaloExchange
+{
+public:
+    enum Method { PERSISTENT, PARTITIONED, DATATYPE, NEIGHBORHOOD, ONE_SIDED };
+
+    /// true if the library supports the given method
+    static bool supported(Method method)
+    {
+#if MPI_VERSION >= 4
+        return true;
+#else
+        return method != PARTITIONED;
+#endif
+    }
+
+    /**
+     * comm is the cartesian communicator, neighbors, chunk and the tags as in main(). Unless the method is DATATYPE,
+     * the faces are packed into sendBuffer and received into receiveBuffer, both of which have to keep their size as
+     * long as the exchange exists.
+     */
+    HaloExchange(Method method, MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2],
+        const unsigned chunk[NUMBER_OF_DIMENSIONS], const int tagSend[NUMBER_OF_DIMENSIONS * 2],
+        const int tagReceive[NUMBER_OF_DIMENSIONS * 2],
+        std::array<std::vector<floatT>, NUMBER_OF_DIMENSIONS * 2>& sendBuffer,
+        std::array<std::vector<floatT>, NUMBER_OF_DIMENSIONS * 2>& receiveBuffer)
+        : method_(method), comm_(comm), sendBuffer_(sendBuffer), receiveBuffer_(receiveBuffer)
+    {
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction) {
+            neighbors_[direction] = neighbors[direction];
+            tagSend_[direction] = tagSend[direction];
+            tagReceive_[direction] = tagReceive[direction];
+        }
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+            size_[coordinate] = chunk[coordinate];
+
+        if (method == NEIGHBORHOOD)
+            neighborhoodArguments();
+        else if (method == ONE_SIDED)
+            createWindow();
+        else if (method != DATATYPE)
+            current_ = bufferRequests();
+    }
+
+    ~HaloExchange()
+    {
+        if (window_ != MPI_WIN_NULL)
+            MPI_Win_free(&window_);
+        if (neighborGroup_ != MPI_GROUP_NULL && neighborGroup_ != MPI_GROUP_EMPTY)
+            MPI_Group_free(&neighborGroup_);
+    }
+
+    HaloExchange(const HaloExchange&) = delete;
+    HaloExchange& operator=(const HaloExchange&) = delete;
+
+    const char* name() const
+    {
+        switch (method_) {
+        case PERSISTENT: return "persistent";
+        case PARTITIONED: return "partitioned";
+        case DATATYPE: return "datatype";
+        case NEIGHBORHOOD: return "neighborhood";
+        default: return "rma";
+        }
+    }
+
+    /// start the receives of the halo for T, pack the faces of T0 and send them
+    void start(const Field3D<floatT>& T0, Field3D<floatT>& T)
+    {
+        if (method_ == DATATYPE) {
+            current_ = fieldRequests(T0, T);
+            target_ = &T;
+            MPI_Startall(NUMBER_OF_DIMENSIONS * 2, current_->receive);
+            MPI_Startall(NUMBER_OF_DIMENSIONS * 2, current_->send);
+            return;
+        }
+
+        if (method_ == ONE_SIDED) {
+            MPI_Win_post(neighborGroup_, 0, window_);
+            for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+                if (neighbors_[direction] != MPI_PROC_NULL)
+                    packFace(direction, T0, sendBuffer_[direction]);
+            MPI_Win_start(neighborGroup_, 0, window_);
+            for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+                if (neighbors_[direction] != MPI_PROC_NULL)
+                    MPI_Put(sendBuffer_[direction].data(), slotSize_[direction], mpiDatatype<floatT>(),
+                        neighbors_[direction], slot_[opposite(direction)], slotSize_[direction], mpiDatatype<floatT>(),
+                        window_);
+            putsCompleted_ = false;
+            delivered_ = -1;
+            return;
+        }
+
+        if (method_ == NEIGHBORHOOD) {
+            for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+                if (neighbors_[direction] != MPI_PROC_NULL)
+                    packFace(direction, T0, sendBuffer_[direction]);
+            MPI_Ineighbor_alltoallw(MPI_BOTTOM, sendCounts_, sendAddresses_, types_, MPI_BOTTOM, receiveCounts_,
+                receiveAddresses_, types_, comm_, &collective_);
+            delivered_ = -1;
+            return;
+        }
+
+        MPI_Startall(NUMBER_OF_DIMENSIONS * 2, current_->receive);
+        if (method_ == PARTITIONED) {
+            MPI_Startall(NUMBER_OF_DIMENSIONS * 2, current_->send);
+            for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+                if (neighbors_[direction] != MPI_PROC_NULL) {
+                    packFace(direction, T0, sendBuffer_[direction]);
+#if MPI_VERSION >= 4
+                    MPI_Pready(0, current_->send[direction]);
+#endif
+                }
+            return;
+        }
+
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+            if (neighbors_[direction] != MPI_PROC_NULL)
+                packFace(direction, T0, sendBuffer_[direction]);
+        MPI_Startall(NUMBER_OF_DIMENSIONS * 2, current_->send);
+    }
+
+    /// the directions of the neighbors whose halo has arrived since the last call, without waiting
+    /**
+     * returns their number, the directions are written into directions.
+     */
+    int arrived(int directions[NUMBER_OF_DIMENSIONS * 2])
+    {
+        int completed = 0, count = 0;
+        if (method_ == NEIGHBORHOOD || method_ == ONE_SIDED) {
+            if (delivered_ >= 0 || !allArrived(false))
+                return 0;
+            for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+                if (neighbors_[direction] != MPI_PROC_NULL)
+                    directions[count++] = direction;
+            delivered_ = NUMBER_OF_DIMENSIONS * 2;
+            return count;
+        }
+
+        int indices[NUMBER_OF_DIMENSIONS * 2];
+        MPI_Testsome(NUMBER_OF_DIMENSIONS * 2, current_->receive, &completed, indices, MPI_STATUSES_IGNORE);
+        for (int index = 0; index < completed; ++index)
+            if (neighbors_[indices[index]] != MPI_PROC_NULL)
+                directions[count++] = indices[index];
+        return count;
+    }
+
+    /// wait for the next halo to arrive and return the direction of its neighbor, -1 once all have arrived
+    int next()
+    {
+        if (method_ == NEIGHBORHOOD || method_ == ONE_SIDED) {
+            if (delivered_ < 0) {
+                allArrived(true);
+                delivered_ = 0;
+            }
+            while (delivered_ < NUMBER_OF_DIMENSIONS * 2)
+                if (neighbors_[delivered_++] != MPI_PROC_NULL)
+                    return delivered_ - 1;
+            return -1;
+        }
+
+        for (;;) {
+            int direction = MPI_UNDEFINED;
+            MPI_Waitany(NUMBER_OF_DIMENSIONS * 2, current_->receive, &direction, MPI_STATUS_IGNORE);
+            if (direction == MPI_UNDEFINED)
+                return -1;
+            if (neighbors_[direction] != MPI_PROC_NULL)
+                return direction;
+        }
+    }
+
+    /// the received halo of the given direction, valid once it has arrived
+    FaceView<floatT> halo(int direction) const
+    {
+        if (method_ == DATATYPE)
+            return ghostFace(direction, *target_);
+        return bufferFace(direction, method_ == ONE_SIDED ? windowBase_ + slot_[direction] :
+            receiveBuffer_[direction].data(), size_);
+    }
+
+    /// wait for the sends, the send buffers are packed again in the next timestep
+    void finish()
+    {
+        if (method_ == NEIGHBORHOOD || method_ == ONE_SIDED)
+            return;
+        MPI_Waitall(NUMBER_OF_DIMENSIONS * 2, current_->send, MPI_STATUSES_IGNORE);
+    }
+
+private:
+    /// the persistent requests of one exchange, for the DATATYPE method together with the fields they are bound to
+    struct Requests
+    {
+        Requests() = default;
+        Requests(const Requests&) = delete;
+        Requests& operator=(const Requests&) = delete;
+
+        ~Requests()
+        {
+            for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction) {
+                MPI_Request_free(&receive[direction]);
+                MPI_Request_free(&send[direction]);
+            }
+            for (MPI_Datatype& type : faceTypes)
+                if (type != MPI_DATATYPE_NULL)
+                    MPI_Type_free(&type);
+        }
+
+        const floatT* from = nullptr;
+        const floatT* to = nullptr;
+        MPI_Request send[NUMBER_OF_DIMENSIONS * 2];
+        MPI_Request receive[NUMBER_OF_DIMENSIONS * 2];
+        std::array<MPI_Datatype, NUMBER_OF_DIMENSIONS * 2> faceTypes;
+    };
+
+    /// the requests on the send and receive buffers
+    Requests* bufferRequests()
+    {
+        std::unique_ptr<Requests> requests(new Requests);
+        requests->faceTypes.fill(MPI_DATATYPE_NULL);
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction) {
+            const int sendCount = static_cast<int>(sendBuffer_[direction].size());
+            const int receiveCount = static_cast<int>(receiveBuffer_[direction].size());
+#if MPI_VERSION >= 4
+            /// MPI_PROC_NULL is no valid partner of a partitioned request, those directions stay persistent
+            if (method_ == PARTITIONED && neighbors_[direction] != MPI_PROC_NULL) {
+                MPI_Precv_init(receiveBuffer_[direction].data(), 1, receiveCount, mpiDatatype<floatT>(),
+                    neighbors_[direction], tagReceive_[direction], comm_, MPI_INFO_NULL, &requests->receive[direction]);
+                MPI_Psend_init(sendBuffer_[direction].data(), 1, sendCount, mpiDatatype<floatT>(),
+                    neighbors_[direction], tagSend_[direction], comm_, MPI_INFO_NULL, &requests->send[direction]);
+                continue;
+            }
+#endif
+            MPI_Recv_init(receiveBuffer_[direction].data(), receiveCount, mpiDatatype<floatT>(), neighbors_[direction],
+                tagReceive_[direction], comm_, &requests->receive[direction]);
+            MPI_Send_init(sendBuffer_[direction].data(), sendCount, mpiDatatype<floatT>(), neighbors_[direction],
+                tagSend_[direction], comm_, &requests->send[direction]);
+        }
+        requests_.push_back(std::move(requests));
+        return requests_.back().get();
+    }
+
+    /// the requests sending from the faces of T0 and receiving into the ghost layers of T, set up on first use
+    Requests* fieldRequests(const Field3D<floatT>& T0, Field3D<floatT>& T)
+    {
+        /// the sets are kept from the least to the most recently used one
+        for (auto requests = requests_.begin(); requests != requests_.end(); ++requests)
+            if ((*requests)->from == T0.origin() && (*requests)->to == T.origin()) {
+                std::rotate(requests, requests + 1, requests_.end());
+                return requests_.back().get();
+            }
+
+        /// a field that was reallocated leaves requests behind that are never used again, the least recently used set
+        /// makes room for the new one
+        if (requests_.size() >= maximumRequestSets)
+            requests_.erase(requests_.begin());
+
+        std::unique_ptr<Requests> requests(new Requests);
+        requests->from = T0.origin();
+        requests->to = T.origin();
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction) {
+            const int normal = direction / 2;
+            const bool upper = direction % 2 == 1;
+            const int a = normal == X ? Y : X;
+            const int b = normal == Z ? Y : Z;
+            requests->faceTypes[direction] = faceType(T, a, b);
+
+            /// the first plane inside the face of T0 goes to the neighbor, whose halo lands in the ghost layer of T
+            const int inside = upper ? static_cast<int>(size_[normal]) - 2 : 1;
+            const int ghost = upper ? static_cast<int>(size_[normal]) : -1;
+            const std::ptrdiff_t corner = stride(T, a) + stride(T, b);
+            MPI_Send_init(T0.origin() + inside * stride(T0, normal) + corner, 1, requests->faceTypes[direction],
+                neighbors_[direction], tagSend_[direction], comm_, &requests->send[direction]);
+            MPI_Recv_init(T.origin() + ghost * stride(T, normal) + corner, 1, requests->faceTypes[direction],
+                neighbors_[direction], tagReceive_[direction], comm_, &requests->receive[direction]);
+        }
+        requests_.push_back(std::move(requests));
+        return requests_.back().get();
+    }
+
+    /// the counts and absolute addresses of the buffers for the neighborhood collective, nothing goes to MPI_PROC_NULL
+    void neighborhoodArguments()
+    {
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction) {
+            const bool exists = neighbors_[direction] != MPI_PROC_NULL;
+            sendCounts_[direction] = exists ? static_cast<int>(sendBuffer_[direction].size()) : 0;
+            receiveCounts_[direction] = exists ? static_cast<int>(receiveBuffer_[direction].size()) : 0;
+            MPI_Get_address(sendBuffer_[direction].data(), &sendAddresses_[direction]);
+            MPI_Get_address(receiveBuffer_[direction].data(), &receiveAddresses_[direction]);
+            types_[direction] = mpiDatatype<floatT>();
+        }
+    }
+
+    /// the window holding the halo of each direction, with a slot for every face so its position is the same on all
+    /// ranks, and the group of the face neighbors
+    void createWindow()
+    {
+        MPI_Aint cells = 0;
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction) {
+            const int normal = direction / 2;
+            const int a = normal == X ? Y : X;
+            const int b = normal == Z ? Y : Z;
+            slot_[direction] = cells;
+            slotSize_[direction] = static_cast<int>((size_[a] - 1) * (size_[b] - 1));
+            cells += slotSize_[direction];
+        }
+        MPI_Win_allocate(cells * static_cast<MPI_Aint>(sizeof(floatT)), static_cast<int>(sizeof(floatT)),
+            MPI_INFO_NULL, comm_, &windowBase_, &window_);
+
+        std::vector<int> ranks;
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+            if (neighbors_[direction] != MPI_PROC_NULL &&
+                std::find(ranks.begin(), ranks.end(), neighbors_[direction]) == ranks.end())
+                ranks.push_back(neighbors_[direction]);
+        MPI_Group group;
+        MPI_Comm_group(comm_, &group);
+        MPI_Group_incl(group, static_cast<int>(ranks.size()), ranks.data(), &neighborGroup_);
+        MPI_Group_free(&group);
+    }
+
+    /// test or wait for the halos that arrive together, i.e. for the collective or the exposure epoch of the window
+    /**
+     * the puts of this rank are completed first, the neighbors wait for them.
+     */
+    bool allArrived(bool wait)
+    {
+        int flag = 1;
+        if (method_ == ONE_SIDED) {
+            if (!putsCompleted_) {
+                MPI_Win_complete(window_);
+                putsCompleted_ = true;
+            }
+            if (wait)
+                MPI_Win_wait(window_);
+            else
+                MPI_Win_test(window_, &flag);
+        }
+        else if (wait)
+            MPI_Wait(&collective_, MPI_STATUS_IGNORE);
+        else
+            MPI_Test(&collective_, &flag, MPI_STATUS_IGNORE);
+        return flag != 0;
+    }
+
+    static std::ptrdiff_t stride(const Field3D<floatT>& field, int coordinate)
+    {
+        return fieldStride(field, coordinate);
+    }
+
+    /// cells 1 <= a, b <= size - 2 of a face spanned by the coordinates a and b, starting at cell (1, 1)
+    MPI_Datatype faceType(const Field3D<floatT>& field, int a, int b) const
+    {
+        MPI_Datatype row, face;
+        const MPI_Aint extent = static_cast<MPI_Aint>(sizeof(floatT));
+        MPI_Type_create_hvector(static_cast<int>(size_[b]) - 2, 1, stride(field, b) * extent, mpiDatatype<floatT>(),
+            &row);
+        MPI_Type_create_hvector(static_cast<int>(size_[a]) - 2, 1, stride(field, a) * extent, row, &face);
+        MPI_Type_commit(&face);
+        MPI_Type_free(&row);
+        return face;
+    }
+
+    /// every ordered pair of the five fields the time loop and the super-time-stepping step between (the two of the
+    /// DoubleBuffer, the first explicit step and the two stages of SuperTimeStepping.h), whose storage is permuted by
+    /// their swaps
+    static const std::size_t maximumRequestSets = 5 * 4;
+
+    Method method_;
+    MPI_Comm comm_;
+    int neighbors_[NUMBER_OF_DIMENSIONS * 2];
+    int tagSend_[NUMBER_OF_DIMENSIONS * 2];
+    int tagReceive_[NUMBER_OF_DIMENSIONS * 2];
+    unsigned size_[NUMBER_OF_DIMENSIONS];
+    std::array<std::vector<floatT>, NUMBER_OF_DIMENSIONS * 2>& sendBuffer_;
+    std::array<std::vector<floatT>, NUMBER_OF_DIMENSIONS * 2>& receiveBuffer_;
+    std::vector<std::unique_ptr<Requests>> requests_;
+    Requests* current_ = nullptr;
+    MPI_Request collective_ = MPI_REQUEST_NULL;
+    int delivered_ = NUMBER_OF_DIMENSIONS * 2;
+    int sendCounts_[NUMBER_OF_DIMENSIONS * 2];
+    int receiveCounts_[NUMBER_OF_DIMENSIONS * 2];
+    MPI_Aint sendAddresses_[NUMBER_OF_DIMENSIONS * 2];
+    MPI_Aint receiveAddresses_[NUMBER_OF_DIMENSIONS * 2];
+    MPI_Datatype types_[NUMBER_OF_DIMENSIONS * 2];
+    MPI_Win window_ = MPI_WIN_NULL;
+    MPI_Group neighborGroup_ = MPI_GROUP_NULL;
+    floatT* windowBase_ = nullptr;
+    MPI_Aint slot_[NUMBER_OF_DIMENSIONS * 2];
+    int slotSize_[NUMBER_OF_DIMENSIONS * 2];
+    bool putsCompleted_ = true;
+    const Field3D<floatT>* target_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/// implicit timesteps (backward Euler or Crank-Nicolson) solved with the distributed Conjugate Gradient solver.
+
+/**
+ * With A from Laplacian.h, the heat equation reads dT/dt = -alpha A T. The theta scheme
+ *
+ * (I + theta tau alpha A) T[n+1] = (I - (1 - theta) tau alpha A) T[n]
+ *
+ * is backward Euler for theta = 1 and Crank-Nicolson for theta = 1/2. Both are unconditionally stable, so the
+ * timestep tau is only limited by the accuracy wanted, not by the CFL condition of the explicit time loop. Divided by
+ * theta tau alpha, the system becomes
+ *
+ * (A + sigma I) T[n+1] = sigma T[n] - (1 - theta) / theta A T[n],   sigma = 1 / (theta tau alpha)
+ *
+ * which is symmetric and positive definite and solved by ConjugateGradient with a shifted operator. The shift makes
+ * the system better conditioned than the steady state, the smaller tau, the fewer iterations are needed. Each solve is
+ * warm-started from T[n], so the initial residual is the change of the solution to be found and shrinks as the
+ * solution approaches the steady state.
+ *
+ * Crank-Nicolson is second order accurate, but damps the high frequencies only weakly for large timesteps, which then
+ * decay in an oscillating way. To approach the steady state with large timesteps, backward Euler is the better choice.
+ *
+ * Unlike the time loop, which extrapolates the edges and corners shared with the neighbors, every unknown is
+ * integrated (see Laplacian.h).
+ */
+
+#ifndef IMPLICITTIMESTEPPING_H
+#define IMPLICITTIMESTEPPING_H
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "ConjugateGradient.h"
+#include "Field3D.h"
+#include "Laplacian.h"
+#include "Stencil.h"
+#include "Threading.h"
+
+template<typename floatT>
+class ImplicitTimeStepping
+{
+public:
+    /**
+     * neighbors, chunk, spacing and nodes as for ConjugateGradient, timestep is tau, alpha the thermal conductivity and
+     * theta 1 for backward Euler or 1/2 for Crank-Nicolson. Each timestep is solved until the residual dropped by
+     * tolerance, with at most maxIterations iterations.
+     */
+    ImplicitTimeStepping(MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2],
+        const unsigned chunk[NUMBER_OF_DIMENSIONS], const floatT spacing[NUMBER_OF_DIMENSIONS],
+        const unsigned nodes[NUMBER_OF_DIMENSIONS], floatT timestep, floatT alpha, floatT theta,
+        typename ConjugateGradient<floatT>::Settings settings, floatT tolerance, unsigned maxIterations)
+        : op_(comm, neighbors, chunk, spacing), timestep_(timestep), theta_(theta),
+          sigma_(1.0 / (theta * timestep * alpha)), tolerance_(tolerance), maxIterations_(maxIterations),
+          solver_(comm, neighbors, chunk, spacing, nodes, shifted(settings, sigma_))
+    {
+        if (theta_ < 1.0)
+            explicitPart_.resize(chunk[X], chunk[Y], chunk[Z]);
+    }
+
+    /// advance y0 by one timestep into y, the change of the interior nodes is added to residual
+    /**
+     * y0 has to hold the boundary values, y is overwritten.
+     */
+    void advance(const Field3D<floatT>& y0, Field3D<floatT>& y, Residual<floatT>* residual)
+    {
+        Field3D<floatT>& x = solver_.solution();
+        Field3D<floatT>& b = solver_.rightHandSide();
+        x = y0;
+
+        const floatT sigma = sigma_;
+        if (theta_ < 1.0) {
+            /// b = sigma T[n] - (1 - theta) / theta A T[n]
+            const floatT weight = (1.0 - theta_) / theta_;
+            const Field3D<floatT>& explicitPart = explicitPart_;
+            op_.exchange(x);
+            op_.apply(x, explicitPart_);
+            op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+                floatT* rhs = &b(i, j, 0);
+                const floatT* t = &y0(i, j, 0);
+                const floatT* a = &explicitPart(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = kBegin; k < kEnd; ++k)
+                    rhs[k] = sigma * t[k] - weight * a[k];
+            });
+        }
+        else {
+            /// b = sigma T[n]
+            op_.forEachRow([&](int i, int j, int kBegin, int kEnd) {
+                floatT* rhs = &b(i, j, 0);
+                const floatT* t = &y0(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = kBegin; k < kEnd; ++k)
+                    rhs[k] = sigma * t[k];
+            });
+        }
+
+        iterations_ += solver_.solve(tolerance_, maxIterations_);
+        ++timesteps_;
+
+        y.swap(x);
+        if (residual)
+            reduceChange(y0, y, *residual);
+    }
+
+    floatT timestep() const { return timestep_; }
+
+    /// the number of timesteps taken and the inner iterations they needed in total
+    unsigned timesteps() const { return timesteps_; }
+    unsigned long iterations() const { return iterations_; }
+
+private:
+    static typename ConjugateGradient<floatT>::Settings shifted(typename ConjugateGradient<floatT>::Settings settings,
+        floatT shift)
+    {
+        settings.shift = shift;
+        return settings;
+    }
+
+    Laplacian<floatT> op_;
+    floatT timestep_;
+    floatT theta_;
+    floatT sigma_;
+    floatT tolerance_;
+    unsigned maxIterations_;
+    ConjugateGradient<floatT> solver_;
+    Field3D<floatT> explicitPart_;
+    unsigned timesteps_ = 0;
+    unsigned long iterations_ = 0;
+};
+
+#endif
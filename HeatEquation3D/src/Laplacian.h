@@ -0,0 +1,196 @@
+/// matrix-free 7-point Laplacian on the distributed grid, used by the steady state solvers.
+
+/**
+ * The steady state of the heat equation is the solution of Laplace's equation. Discretised with the same central
+ * scheme as the time loop, it reads A T = 0 with
+ *
+ * (A T)[i, j, k] = cx * (2 T[i, j, k] - T[i-1, j, k] - T[i+1, j, k])
+ *                + cy * (2 T[i, j, k] - T[i, j-1, k] - T[i, j+1, k])
+ *                + cz * (2 T[i, j, k] - T[i, j, k-1] - T[i, j, k+1]),   c = 1 / spacing^2
+ *
+ * for every node that does not lie on the boundary of the domain (the unknowns), while the boundary nodes keep their
+ * Dirichlet values. A is symmetric and positive definite on the unknowns.
+ *
+ * Neighboring sub-domains share the plane of nodes on their common face (see chunck in main()). Both processors hold
+ * and update the nodes of that plane with the same arithmetic, so their values stay identical. For global reductions,
+ * each shared node is only counted by the processor for which it is plane 0, i.e. the one on its upper side.
+ *
+ * With a shift sigma, the operator is A + sigma I instead, which is the matrix of an implicit timestep (see
+ * ImplicitTimeStepping.h). The shift only adds to the diagonal.
+ *
+ * Unlike the time loop, which extrapolates the edges and averages the corners of each sub-domain, every unknown is
+ * updated with the full stencil. The ghost layer is exchanged one coordinate direction after the other (see
+ * DeepHalo.h), which fills the diagonal ghost cells needed at the edges and corners.
+ */
+
+#ifndef LAPLACIAN_H
+#define LAPLACIAN_H
+
+#include <cmath>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "DeepHalo.h"
+#include "Field3D.h"
+#include "Threading.h"
+
+/// the nodes [lo, hi) of a sub-domain in local indices
+struct NodeRange
+{
+    int lo[NUMBER_OF_DIMENSIONS];
+    int hi[NUMBER_OF_DIMENSIONS];
+};
+
+template<typename floatT>
+class Laplacian
+{
+public:
+    Laplacian(MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2], const unsigned chunk[NUMBER_OF_DIMENSIONS],
+        const floatT spacing[NUMBER_OF_DIMENSIONS], floatT shift = 0.0)
+        : comm_(comm), halo_(comm, neighbors, chunk, 1)
+    {
+        diagonal_ = shift;
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            const bool lower = neighbors[2 * coordinate] != MPI_PROC_NULL;
+            const bool upper = neighbors[2 * coordinate + 1] != MPI_PROC_NULL;
+            const int size = static_cast<int>(chunk[coordinate]);
+
+            size_[coordinate] = chunk[coordinate];
+            coefficient_[coordinate] = 1.0 / (spacing[coordinate] * spacing[coordinate]);
+            diagonal_ += 2.0 * coefficient_[coordinate];
+
+            unknowns_.lo[coordinate] = lower ? 0 : 1;
+            unknowns_.hi[coordinate] = upper ? size : size - 1;
+            owned_.lo[coordinate] = unknowns_.lo[coordinate];
+            owned_.hi[coordinate] = size - 1;
+        }
+    }
+
+    /// fill the ghost layer of x with the nodes of the neighbors
+    void exchange(Field3D<floatT>& x) { halo_.exchange(x); }
+
+    /// fill the ghost layer of x with the nodes of one colour only, see DeepHaloExchange
+    void exchange(Field3D<floatT>& x, int colour, int parity) { halo_.exchange(x, colour, parity); }
+
+    /// y = A x on all unknowns (A + shift I for a shifted operator), the ghost layer of x has to be up to date
+    void apply(const Field3D<floatT>& x, Field3D<floatT>& y) const
+    {
+        const floatT cx = coefficient_[X], cy = coefficient_[Y], cz = coefficient_[Z], diagonal = diagonal_;
+        const NodeRange& u = unknowns_;
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = u.lo[X]; i < u.hi[X]; ++i)
+            for (int j = u.lo[Y]; j < u.hi[Y]; ++j) {
+                const floatT* c = &x(i, j, 0);
+                const floatT* west = &x(i - 1, j, 0);
+                const floatT* east = &x(i + 1, j, 0);
+                const floatT* south = &x(i, j - 1, 0);
+                const floatT* north = &x(i, j + 1, 0);
+                floatT* out = &y(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = u.lo[Z]; k < u.hi[Z]; ++k)
+                    out[k] = diagonal * c[k] - cx * (west[k] + east[k]) - cy * (south[k] + north[k]) -
+                        cz * (c[k - 1] + c[k + 1]);
+            }
+    }
+
+    /// r = b - A x on all unknowns, the ghost layer of x has to be up to date
+    void residual(const Field3D<floatT>& x, const Field3D<floatT>& b, Field3D<floatT>& r) const
+    {
+        const floatT cx = coefficient_[X], cy = coefficient_[Y], cz = coefficient_[Z], diagonal = diagonal_;
+        const NodeRange& u = unknowns_;
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = u.lo[X]; i < u.hi[X]; ++i)
+            for (int j = u.lo[Y]; j < u.hi[Y]; ++j) {
+                const floatT* c = &x(i, j, 0);
+                const floatT* west = &x(i - 1, j, 0);
+                const floatT* east = &x(i + 1, j, 0);
+                const floatT* south = &x(i, j - 1, 0);
+                const floatT* north = &x(i, j + 1, 0);
+                const floatT* rhs = &b(i, j, 0);
+                floatT* out = &r(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = u.lo[Z]; k < u.hi[Z]; ++k)
+                    out[k] = rhs[k] - (diagonal * c[k] - cx * (west[k] + east[k]) - cy * (south[k] + north[k]) -
+                        cz * (c[k - 1] + c[k + 1]));
+            }
+    }
+
+    /// the contribution of this processor to the dot product of a and b, each node is counted on one processor only
+    floatT localDot(const Field3D<floatT>& a, const Field3D<floatT>& b) const
+    {
+        const NodeRange& o = owned_;
+        floatT sum = 0.0;
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static) reduction(+:sum))
+        for (int i = o.lo[X]; i < o.hi[X]; ++i)
+            for (int j = o.lo[Y]; j < o.hi[Y]; ++j) {
+                const floatT* rowA = &a(i, j, 0);
+                const floatT* rowB = &b(i, j, 0);
+                HEAT3D_OMP(simd reduction(+:sum))
+                for (int k = o.lo[Z]; k < o.hi[Z]; ++k)
+                    sum += rowA[k] * rowB[k];
+            }
+        return sum;
+    }
+
+    /// the dot product of a and b over all processors
+    floatT dot(const Field3D<floatT>& a, const Field3D<floatT>& b) const
+    {
+        floatT value = localDot(a, b);
+        sum(&value, 1);
+        return value;
+    }
+
+    /// replace values[0 ... count) by their sums over all processors, several dot products share one reduction
+    void sum(floatT* values, int count) const
+    {
+        MPI_Request request;
+        startSum(values, count, request);
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+    }
+
+    /// start summing values[0 ... count) over all processors in place, the result is available after MPI_Wait(request)
+    void startSum(floatT* values, int count, MPI_Request& request) const
+    {
+        MPI_Iallreduce(MPI_IN_PLACE, values, count, mpiDatatype<floatT>(), MPI_SUM, comm_, &request);
+    }
+
+    /// call kernel(i, j, kBegin, kEnd) for every row of the unknowns, the rows are shared among the threads
+    template<typename Kernel>
+    void forEachRow(Kernel kernel) const
+    {
+        const NodeRange& u = unknowns_;
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = u.lo[X]; i < u.hi[X]; ++i)
+            for (int j = u.lo[Y]; j < u.hi[Y]; ++j)
+                kernel(i, j, u.lo[Z], u.hi[Z]);
+    }
+
+    /// the L2-norm of x over all processors
+    floatT norm(const Field3D<floatT>& x) const { return std::sqrt(dot(x, x)); }
+
+    /// the nodes updated by this processor, including those shared with a neighbor
+    const NodeRange& unknowns() const { return unknowns_; }
+
+    /// the nodes counted by this processor in global reductions
+    const NodeRange& owned() const { return owned_; }
+
+    floatT diagonal() const { return diagonal_; }
+    floatT coefficient(int coordinate) const { return coefficient_[coordinate]; }
+    unsigned size(int coordinate) const { return size_[coordinate]; }
+    MPI_Comm comm() const { return comm_; }
+
+private:
+    MPI_Comm comm_;
+    DeepHaloExchange<floatT> halo_;
+    unsigned size_[NUMBER_OF_DIMENSIONS];
+    floatT coefficient_[NUMBER_OF_DIMENSIONS];
+    floatT diagonal_;
+    NodeRange unknowns_;
+    NodeRange owned_;
+};
+
+#endif
@@ -0,0 +1,395 @@
+/// geometric multigrid solver for the steady state, distributed over the same cartesian decomposition as the time loop.
+
+/**
+ * The explicit time loop removes the smooth components of the error very slowly, it needs O(N^2) timesteps to reach
+ * the steady state. Multigrid removes the oscillatory components with a few smoothing sweeps on the fine grid and
+ * solves for the smooth remainder on a coarser grid, recursively, which takes O(1) cycles independent of N.
+ *
+ * The grids are node based: coarse node I coincides with fine node 2 I, and the coarse spacing is twice the fine one.
+ * As each sub-domain holds chunck nodes with the nodes on its faces shared with the neighbors, a level can be coarsened
+ * on the same decomposition as long as chunck - 1 is even in every direction. The operators are
+ *
+ * - smoothing:     weighted Jacobi, x += 6/7 * (b - A x) / diagonal, with one halo exchange per sweep
+ * - restriction:   full weighting of the residual, i.e. the tensor product of the weights 1/4, 1/2, 1/4
+ * - prolongation:  trilinear interpolation of the coarse correction
+ * - coarse levels: the operator of Laplacian.h rediscretised with the coarse spacing
+ *
+ * Once the sub-domains can not be coarsened any further, the coarsest distributed level would be tiny on each processor
+ * and dominated by latency. If the whole level has at most agglomeration nodes, it is gathered onto rank 0
+ * (agglomeration), which solves it with a serial multigrid hierarchy of its own, that can usually be coarsened further,
+ * and scatters the result back. Otherwise, the coarsest level is solved with Jacobi sweeps.
+ *
+ * For a good hierarchy, (NUM_CELLS - 1) / processors in each direction should be divisible by a large power of two.
+ */
+
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "Laplacian.h"
+#include "Threading.h"
+
+template<typename floatT>
+class Multigrid
+{
+public:
+    struct Settings
+    {
+        /// number of coarse grid corrections per level, 1 for a V-cycle and 2 for a W-cycle
+        int cycleIndex = 1;
+
+        /// Jacobi sweeps before and after each coarse grid correction
+        int smoothing = 2;
+
+        /// largest number of nodes of a level that is gathered onto rank 0
+        long agglomeration = 32768;
+
+        /// reduction of the residual on the coarsest level, relative to its first residual
+        floatT coarseTolerance = 1.0e-3;
+
+        /// maximum number of Jacobi sweeps on the coarsest level
+        int coarseSweeps = 1000;
+    };
+
+    /**
+     * dimensions and coordinates describe the cartesian topology of comm, neighbors, chunk and spacing the finest level
+     * of this processor in the same way as in main().
+     */
+    Multigrid(MPI_Comm comm, const int dimensions[NUMBER_OF_DIMENSIONS], const int coordinates[NUMBER_OF_DIMENSIONS],
+        const int neighbors[NUMBER_OF_DIMENSIONS * 2], const unsigned chunk[NUMBER_OF_DIMENSIONS],
+        const floatT spacing[NUMBER_OF_DIMENSIONS], const Settings& settings)
+        : comm_(comm), settings_(settings)
+    {
+        unsigned size[NUMBER_OF_DIMENSIONS] = { chunk[X], chunk[Y], chunk[Z] };
+        floatT h[NUMBER_OF_DIMENSIONS] = { spacing[X], spacing[Y], spacing[Z] };
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+            dimensions_[coordinate] = dimensions[coordinate];
+
+        levels_.emplace_back(new Level(comm, neighbors, size, h));
+        while (coarsen(size, h))
+            levels_.emplace_back(new Level(comm, neighbors, size, h));
+
+        int processors, rank;
+        MPI_Comm_size(comm_, &processors);
+        MPI_Comm_rank(comm_, &rank);
+        if (processors > 1 && levels_.size() > 1 && globalNodes(size) <= settings_.agglomeration)
+            agglomerate(coordinates, size, h, rank, processors);
+    }
+
+    /// the solution on the finest level, holding the Dirichlet values on the boundary
+    Field3D<floatT>& solution() { return levels_.front()->x; }
+
+    /// the right hand side on the finest level, zero for Laplace's equation
+    Field3D<floatT>& rightHandSide() { return levels_.front()->b; }
+
+    /// run cycles until the L2-norm of the residual dropped by tolerance or maxCycles were taken
+    /**
+     * returns the number of cycles taken, solution() is used as the initial guess.
+     */
+    unsigned solve(floatT tolerance, unsigned maxCycles)
+    {
+        Level& fine = *levels_.front();
+        fine.op.exchange(fine.x);
+        fine.op.residual(fine.x, fine.b, fine.r);
+        initialResidual_ = residual_ = fine.op.norm(fine.r);
+
+        unsigned cycles = 0;
+        while (cycles < maxCycles && residual_ > tolerance * initialResidual_) {
+            cycle(0);
+            ++cycles;
+            fine.op.exchange(fine.x);
+            fine.op.residual(fine.x, fine.b, fine.r);
+            residual_ = fine.op.norm(fine.r);
+        }
+        return cycles;
+    }
+
+    /// L2-norm of the residual before the first and after the last cycle of solve(...)
+    floatT initialResidual() const { return initialResidual_; }
+    floatT residual() const { return residual_; }
+
+    /// number of levels on the decomposition of comm, levels of the agglomerated hierarchy are not included
+    int distributedLevels() const { return static_cast<int>(levels_.size()); }
+
+    /// whether the coarsest distributed level is gathered onto rank 0
+    bool agglomerated() const { return agglomerated_; }
+
+    /// print the size of each level, the agglomerated levels are only known on rank 0
+    void describe(std::ostream& out) const
+    {
+        for (std::size_t level = 0; level < levels_.size(); ++level) {
+            const Laplacian<floatT>& op = levels_[level]->op;
+            out << "level " << level << ": " << (op.size(X) - 1) * dimensions_[X] + 1 << " x "
+                << (op.size(Y) - 1) * dimensions_[Y] + 1 << " x " << (op.size(Z) - 1) * dimensions_[Z] + 1
+                << " nodes, " << op.size(X) << " x " << op.size(Y) << " x " << op.size(Z) << " per processor"
+                << std::endl;
+        }
+        if (serial_) {
+            out << "agglomerated onto rank 0:" << std::endl;
+            serial_->describe(out);
+        }
+    }
+
+private:
+    struct Level
+    {
+        Level(MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2], const unsigned size[NUMBER_OF_DIMENSIONS],
+            const floatT spacing[NUMBER_OF_DIMENSIONS])
+            : op(comm, neighbors, size, spacing), x(size[X], size[Y], size[Z]), b(size[X], size[Y], size[Z]),
+            r(size[X], size[Y], size[Z])
+        {
+        }
+
+        Laplacian<floatT> op;
+        Field3D<floatT> x;
+        Field3D<floatT> b;
+        Field3D<floatT> r;
+    };
+
+    /// the size and spacing of the next coarser level, returns false if the level can not be coarsened
+    bool coarsen(unsigned size[NUMBER_OF_DIMENSIONS], floatT spacing[NUMBER_OF_DIMENSIONS]) const
+    {
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            const unsigned intervals = size[coordinate] - 1;
+            if (intervals % 2 != 0 || intervals * dimensions_[coordinate] < 4)
+                return false;
+        }
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            size[coordinate] = (size[coordinate] - 1) / 2 + 1;
+            spacing[coordinate] *= 2.0;
+        }
+        return true;
+    }
+
+    long globalNodes(const unsigned size[NUMBER_OF_DIMENSIONS]) const
+    {
+        long nodes = 1;
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+            nodes *= static_cast<long>(size[coordinate] - 1) * dimensions_[coordinate] + 1;
+        return nodes;
+    }
+
+    /// set up the serial hierarchy on rank 0 for the coarsest level, which has the given size on each processor
+    void agglomerate(const int coordinates[NUMBER_OF_DIMENSIONS], const unsigned size[NUMBER_OF_DIMENSIONS],
+        const floatT spacing[NUMBER_OF_DIMENSIONS], int rank, int processors)
+    {
+        agglomerated_ = true;
+        blockSize_ = static_cast<int>(size[X] * size[Y] * size[Z]);
+        block_.resize(blockSize_);
+        if (rank == 0) {
+            gathered_.resize(static_cast<std::size_t>(blockSize_) * processors);
+            offsets_.resize(NUMBER_OF_DIMENSIONS * processors);
+        }
+        MPI_Gather(coordinates, NUMBER_OF_DIMENSIONS, MPI_INT, offsets_.data(), NUMBER_OF_DIMENSIONS, MPI_INT, 0, comm_);
+
+        if (rank == 0) {
+            for (int processor = 0; processor < processors; ++processor)
+                for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+                    offsets_[NUMBER_OF_DIMENSIONS * processor + coordinate] *= size[coordinate] - 1;
+
+            const int one[NUMBER_OF_DIMENSIONS] = { 1, 1, 1 };
+            const int origin[NUMBER_OF_DIMENSIONS] = { 0, 0, 0 };
+            const int none[NUMBER_OF_DIMENSIONS * 2] = {
+                MPI_PROC_NULL, MPI_PROC_NULL, MPI_PROC_NULL, MPI_PROC_NULL, MPI_PROC_NULL, MPI_PROC_NULL
+            };
+            unsigned global[NUMBER_OF_DIMENSIONS];
+            for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+                global[coordinate] = (size[coordinate] - 1) * dimensions_[coordinate] + 1;
+            serial_.reset(new Multigrid(MPI_COMM_SELF, one, origin, none, global, spacing, settings_));
+        }
+    }
+
+    /// one V- (or W-) cycle on the given level, the right hand side and the initial guess are in b and x
+    void cycle(std::size_t level)
+    {
+        if (level + 1 == levels_.size()) {
+            solveCoarsest();
+            return;
+        }
+
+        Level& fine = *levels_[level];
+        Level& coarse = *levels_[level + 1];
+
+        smooth(fine, settings_.smoothing);
+
+        fine.op.exchange(fine.x);
+        fine.op.residual(fine.x, fine.b, fine.r);
+        fine.op.exchange(fine.r);
+        restrictResidual(fine.r, coarse);
+        coarse.x.fill(0.0);
+
+        /// the coarsest level is solved, visiting it again would not change its solution
+        const int visits = level + 2 == levels_.size() ? 1 : settings_.cycleIndex;
+        for (int visit = 0; visit < visits; ++visit)
+            cycle(level + 1);
+
+        prolongate(coarse.x, fine);
+        smooth(fine, settings_.smoothing);
+    }
+
+    void smooth(Level& level, int sweeps)
+    {
+        for (int sweep = 0; sweep < sweeps; ++sweep) {
+            level.op.exchange(level.x);
+            level.op.residual(level.x, level.b, level.r);
+            relax(level);
+        }
+    }
+
+    /// x += omega * r / diagonal on all unknowns, 6/7 is the weight that damps the oscillatory modes best in 3D
+    void relax(Level& level)
+    {
+        const floatT weight = 6.0 / 7.0 / level.op.diagonal();
+        const NodeRange& u = level.op.unknowns();
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = u.lo[X]; i < u.hi[X]; ++i)
+            for (int j = u.lo[Y]; j < u.hi[Y]; ++j) {
+                floatT* x = &level.x(i, j, 0);
+                const floatT* r = &level.r(i, j, 0);
+                HEAT3D_OMP(simd)
+                for (int k = u.lo[Z]; k < u.hi[Z]; ++k)
+                    x[k] += weight * r[k];
+            }
+    }
+
+    void solveCoarsest()
+    {
+        Level& level = *levels_.back();
+        if (agglomerated_) {
+            solveAgglomerated(level);
+            return;
+        }
+
+        floatT first = 0.0;
+        for (int sweep = 0; sweep < settings_.coarseSweeps; ++sweep) {
+            level.op.exchange(level.x);
+            level.op.residual(level.x, level.b, level.r);
+            const floatT norm = level.op.norm(level.r);
+            if (sweep == 0)
+                first = norm;
+            if (norm <= settings_.coarseTolerance * first)
+                break;
+            relax(level);
+        }
+    }
+
+    /// gather the right hand side onto rank 0, solve there and scatter the solution back
+    void solveAgglomerated(Level& level)
+    {
+        const unsigned size[NUMBER_OF_DIMENSIONS] = { level.op.size(X), level.op.size(Y), level.op.size(Z) };
+
+        copyBlock(level.b, size, block_.data(), true);
+        MPI_Gather(block_.data(), blockSize_, mpiDatatype<floatT>(), gathered_.data(), blockSize_,
+            mpiDatatype<floatT>(), 0, comm_);
+
+        if (serial_) {
+            Field3D<floatT>& b = serial_->rightHandSide();
+            Field3D<floatT>& x = serial_->solution();
+            const int processors = static_cast<int>(offsets_.size()) / NUMBER_OF_DIMENSIONS;
+            for (int processor = 0; processor < processors; ++processor)
+                copyBlock(b, size, gathered_.data() + static_cast<std::size_t>(blockSize_) * processor, false,
+                    &offsets_[NUMBER_OF_DIMENSIONS * processor]);
+
+            x.fill(0.0);
+            serial_->solve(settings_.coarseTolerance, static_cast<unsigned>(settings_.coarseSweeps));
+
+            for (int processor = 0; processor < processors; ++processor)
+                copyBlock(x, size, gathered_.data() + static_cast<std::size_t>(blockSize_) * processor, true,
+                    &offsets_[NUMBER_OF_DIMENSIONS * processor]);
+        }
+
+        MPI_Scatter(gathered_.data(), blockSize_, mpiDatatype<floatT>(), block_.data(), blockSize_,
+            mpiDatatype<floatT>(), 0, comm_);
+        copyBlock(level.x, size, block_.data(), false);
+    }
+
+    /// copy the block of size nodes starting at offset between field and buffer, in the given direction
+    static void copyBlock(Field3D<floatT>& field, const unsigned size[NUMBER_OF_DIMENSIONS], floatT* buffer,
+        bool toBuffer, const int* offset = nullptr)
+    {
+        const int zero[NUMBER_OF_DIMENSIONS] = { 0, 0, 0 };
+        if (!offset)
+            offset = zero;
+
+        std::size_t index = 0;
+        for (unsigned i = 0; i < size[X]; ++i)
+            for (unsigned j = 0; j < size[Y]; ++j)
+                for (unsigned k = 0; k < size[Z]; ++k, ++index) {
+                    floatT& node = field(offset[X] + i, offset[Y] + j, offset[Z] + k);
+                    if (toBuffer)
+                        buffer[index] = node;
+                    else
+                        node = buffer[index];
+                }
+    }
+
+    /// full weighting of the fine residual r onto the right hand side of the coarse level, the halo of r is needed
+    static void restrictResidual(const Field3D<floatT>& r, Level& coarse)
+    {
+        const NodeRange& u = coarse.op.unknowns();
+        const floatT weight[3] = { 0.25, 0.5, 0.25 };
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int I = u.lo[X]; I < u.hi[X]; ++I)
+            for (int J = u.lo[Y]; J < u.hi[Y]; ++J)
+                for (int K = u.lo[Z]; K < u.hi[Z]; ++K) {
+                    floatT sum = 0.0;
+                    for (int di = -1; di <= 1; ++di)
+                        for (int dj = -1; dj <= 1; ++dj) {
+                            const floatT* row = &r(2 * I + di, 2 * J + dj, 2 * K);
+                            const floatT w = weight[di + 1] * weight[dj + 1];
+                            sum += w * (weight[0] * row[-1] + weight[1] * row[0] + weight[2] * row[1]);
+                        }
+                    coarse.b(I, J, K) = sum;
+                }
+    }
+
+    /// add the trilinear interpolation of the coarse correction to x on all unknowns of the fine level
+    /**
+     * fine node i lies between the coarse nodes i / 2 and (i + 1) / 2, which coincide for even i. Averaging over both
+     * in each direction therefore covers the injection and the interpolation at once.
+     */
+    static void prolongate(const Field3D<floatT>& correction, Level& fine)
+    {
+        const NodeRange& u = fine.op.unknowns();
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = u.lo[X]; i < u.hi[X]; ++i)
+            for (int j = u.lo[Y]; j < u.hi[Y]; ++j)
+                for (int k = u.lo[Z]; k < u.hi[Z]; ++k) {
+                    const int I[2] = { i / 2, (i + 1) / 2 };
+                    const int J[2] = { j / 2, (j + 1) / 2 };
+                    const int K[2] = { k / 2, (k + 1) / 2 };
+                    floatT sum = 0.0;
+                    for (int a = 0; a < 2; ++a)
+                        for (int b = 0; b < 2; ++b)
+                            sum += correction(I[a], J[b], K[0]) + correction(I[a], J[b], K[1]);
+                    fine.x(i, j, k) += 0.125 * sum;
+                }
+    }
+
+    MPI_Comm comm_;
+    Settings settings_;
+    int dimensions_[NUMBER_OF_DIMENSIONS];
+    std::vector<std::unique_ptr<Level>> levels_;
+    floatT initialResidual_ = 0.0;
+    floatT residual_ = 0.0;
+
+    bool agglomerated_ = false;
+    int blockSize_ = 0;
+    std::vector<floatT> block_;
+    std::vector<floatT> gathered_;
+    std::vector<int> offsets_;
+    std::unique_ptr<Multigrid> serial_;
+};
+
+#endif
@@ -0,0 +1,192 @@
+/// nested iteration: solve the steady state on coarser grids first and interpolate the result as the initial guess.
+
+/**
+ * Starting from T = 0 in the interior, the time loop and the iterative solvers spend most of their iterations on the
+ * smooth components of the error, which a coarser grid resolves with a fraction of the nodes and of the iterations.
+ * The nested iteration (the first half of full multigrid) solves on the grids coarsened by 2, 4, ... in every
+ * direction, coarsest first, and interpolates each solution as the initial guess of the next finer grid, the last one
+ * into T.
+ *
+ * The coarse grids use the same decomposition and node numbering as Multigrid.h: coarse node I coincides with fine
+ * node 2 I, so a grid can be coarsened as long as chunck - 1 is even in every direction. Their boundary values are
+ * injected from T, their unknowns are solved with red-black SOR (see RedBlackSOR.h) until the residual dropped by the
+ * tolerance and interpolated trilinearly into the unknowns of the next finer grid.
+ *
+ * As the residual of the warm start is much smaller than that of T = 0, a convergence threshold relative to the first
+ * residual would become stricter. reduction() is the ratio of both, by which the threshold can be scaled to keep it
+ * relative to the cold start.
+ */
+
+#ifndef NESTEDITERATION_H
+#define NESTEDITERATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "Laplacian.h"
+#include "RedBlackSOR.h"
+#include "Threading.h"
+
+template<typename floatT>
+class NestedIteration
+{
+public:
+    /**
+     * coordinates, neighbors, chunk, spacing and nodes as in main(), for the finest grid. At most levels coarse grids
+     * are set up, fewer if the sub-domains can not be coarsened that often.
+     */
+    NestedIteration(MPI_Comm comm, const int coordinates[NUMBER_OF_DIMENSIONS],
+        const int neighbors[NUMBER_OF_DIMENSIONS * 2], const unsigned chunk[NUMBER_OF_DIMENSIONS],
+        const floatT spacing[NUMBER_OF_DIMENSIONS], const unsigned nodes[NUMBER_OF_DIMENSIONS], int levels)
+        : comm_(comm), fine_(comm, neighbors, chunk, spacing), residual_(chunk[X], chunk[Y], chunk[Z])
+    {
+        unsigned size[NUMBER_OF_DIMENSIONS] = { chunk[X], chunk[Y], chunk[Z] };
+        unsigned global[NUMBER_OF_DIMENSIONS] = { nodes[X], nodes[Y], nodes[Z] };
+        floatT h[NUMBER_OF_DIMENSIONS] = { spacing[X], spacing[Y], spacing[Z] };
+
+        for (int level = 0; level < levels; ++level) {
+            for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+                if ((size[coordinate] - 1) % 2 != 0 || (global[coordinate] - 1) / 2 < 2)
+                    return;
+            unsigned offset[NUMBER_OF_DIMENSIONS];
+            for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+                size[coordinate] = (size[coordinate] - 1) / 2 + 1;
+                global[coordinate] = (global[coordinate] - 1) / 2 + 1;
+                h[coordinate] *= 2.0;
+                offset[coordinate] = coordinates[coordinate] * (size[coordinate] - 1);
+            }
+            levels_.emplace_back(new Level(comm, neighbors, size, h, global, offset));
+        }
+    }
+
+    /// the number of coarse grids, which may be less than asked for
+    int levels() const { return static_cast<int>(levels_.size()); }
+
+    /// solve on the coarse grids and interpolate into the unknowns of T, which has to hold the boundary values
+    /**
+     * each coarse grid is solved until the L2-norm of its residual dropped by tolerance, with at most maxSweeps. The
+     * sweeps and the wall time of each grid are written to log, if given.
+     */
+    void warmStart(Field3D<floatT>& T, floatT tolerance, unsigned maxSweeps, std::ostream* log)
+    {
+        residualNorms(T, coldL2_, coldMaximum_);
+
+        /// the boundary values of each grid are injected from the next finer one
+        for (std::size_t level = 0; level < levels_.size(); ++level)
+            inject(level == 0 ? T : levels_[level - 1]->x, levels_[level]->x);
+
+        for (std::size_t level = levels_.size(); level-- > 0;) {
+            Level& coarse = *levels_[level];
+            const double start = MPI_Wtime();
+
+            coarse.x.swap(coarse.solver.solution());
+            const unsigned sweeps = coarse.solver.solve(tolerance, maxSweeps);
+            coarse.x.swap(coarse.solver.solution());
+            Field3D<floatT>& finer = level == 0 ? T : levels_[level - 1]->x;
+            interpolate(coarse.x, finer, level == 0 ? fine_.unknowns() : levels_[level - 1]->unknowns);
+
+            if (log)
+                *log << "Nested iteration on " << coarse.nodes[X] << " x " << coarse.nodes[Y] << " x "
+                    << coarse.nodes[Z] << " nodes: " << sweeps << " SOR sweeps, residual " << std::scientific
+                    << std::setprecision(5) << coarse.solver.initialResidual() << " -> " << coarse.solver.residual()
+                    << ", " << std::fixed << std::setprecision(6) << MPI_Wtime() - start << " s"
+                    << std::defaultfloat << std::endl;
+        }
+
+        residualNorms(T, warmL2_, warmMaximum_);
+    }
+
+    /// the residual of the warm start relative to that of the initial T, in the L2- or the maximum norm
+    floatT reduction(bool l2) const
+    {
+        const floatT cold = l2 ? coldL2_ : coldMaximum_;
+        const floatT warm = l2 ? warmL2_ : warmMaximum_;
+        return cold > 0.0 ? warm / cold : 1.0;
+    }
+
+private:
+    struct Level
+    {
+        Level(MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2], const unsigned size[NUMBER_OF_DIMENSIONS],
+            const floatT spacing[NUMBER_OF_DIMENSIONS], const unsigned global[NUMBER_OF_DIMENSIONS],
+            const unsigned offset[NUMBER_OF_DIMENSIONS])
+            : solver(comm, neighbors, size, spacing, global, offset), x(size[X], size[Y], size[Z])
+        {
+            for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+                nodes[coordinate] = global[coordinate];
+                unknowns.lo[coordinate] = neighbors[2 * coordinate] != MPI_PROC_NULL ? 0 : 1;
+                unknowns.hi[coordinate] = static_cast<int>(neighbors[2 * coordinate + 1] != MPI_PROC_NULL ?
+                    size[coordinate] : size[coordinate] - 1);
+            }
+        }
+
+        RedBlackSOR<floatT> solver;
+        Field3D<floatT> x;
+        unsigned nodes[NUMBER_OF_DIMENSIONS];
+        NodeRange unknowns;
+    };
+
+    /// the L2- and the maximum norm of A x on the finest grid over all processors
+    void residualNorms(Field3D<floatT>& x, floatT& l2, floatT& maximum)
+    {
+        fine_.exchange(x);
+        fine_.apply(x, residual_);
+        l2 = fine_.norm(residual_);
+
+        const NodeRange& o = fine_.owned();
+        const Field3D<floatT>& r = residual_;
+        floatT localMaximum = 0.0;
+        HEAT3D_OMP(parallel for collapse(2) schedule(static) reduction(max:localMaximum))
+        for (int i = o.lo[X]; i < o.hi[X]; ++i)
+            for (int j = o.lo[Y]; j < o.hi[Y]; ++j)
+                for (int k = o.lo[Z]; k < o.hi[Z]; ++k)
+                    localMaximum = std::max(localMaximum, std::fabs(r(i, j, k)));
+        MPI_Allreduce(&localMaximum, &maximum, 1, mpiDatatype<floatT>(), MPI_MAX, comm_);
+    }
+
+    /// coarse node I = fine node 2 I on all nodes of the coarse grid
+    static void inject(const Field3D<floatT>& fine, Field3D<floatT>& coarse)
+    {
+        const int sizeX = static_cast<int>(coarse.size(X)), sizeY = static_cast<int>(coarse.size(Y));
+        const int sizeZ = static_cast<int>(coarse.size(Z));
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int I = 0; I < sizeX; ++I)
+            for (int J = 0; J < sizeY; ++J)
+                for (int K = 0; K < sizeZ; ++K)
+                    coarse(I, J, K) = fine(2 * I, 2 * J, 2 * K);
+    }
+
+    /// trilinear interpolation of the coarse solution into the unknowns u of the fine grid, as in Multigrid.h
+    static void interpolate(const Field3D<floatT>& coarse, Field3D<floatT>& fine, const NodeRange& u)
+    {
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = u.lo[X]; i < u.hi[X]; ++i)
+            for (int j = u.lo[Y]; j < u.hi[Y]; ++j)
+                for (int k = u.lo[Z]; k < u.hi[Z]; ++k) {
+                    const int I[2] = { i / 2, (i + 1) / 2 };
+                    const int J[2] = { j / 2, (j + 1) / 2 };
+                    const int K[2] = { k / 2, (k + 1) / 2 };
+                    floatT sum = 0.0;
+                    for (int a = 0; a < 2; ++a)
+                        for (int b = 0; b < 2; ++b)
+                            sum += coarse(I[a], J[b], K[0]) + coarse(I[a], J[b], K[1]);
+                    fine(i, j, k) = 0.125 * sum;
+                }
+    }
+
+    MPI_Comm comm_;
+    Laplacian<floatT> fine_;
+    Field3D<floatT> residual_;
+    std::vector<std::unique_ptr<Level>> levels_;
+    floatT coldL2_ = 0.0, coldMaximum_ = 0.0;
+    floatT warmL2_ = 0.0, warmMaximum_ = 0.0;
+};
+
+#endif
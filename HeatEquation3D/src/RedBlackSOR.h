@@ -0,0 +1,136 @@
+/// red-black successive over-relaxation (SOR) for the steady state, updating a single field in place.
+
+/**
+ * The nodes are coloured like a checkerboard by the parity of their global index, I + J + K. All six neighbors of a
+ * node have the other colour, so all nodes of one colour can be updated at the same time (and in any order) from the
+ * nodes of the other colour:
+ *
+ * x = x + omega * (b - A x) / diagonal   for all nodes of one colour, then for all nodes of the other colour
+ *
+ * Each half-sweep is followed by a halo exchange of the colour it has just updated, which is all that the next half
+ * sweep reads from the neighbors. Only every other node of each face is sent. The update works in place, no second
+ * field (like T0 in the time loop) and no residual field is needed. For omega = 1 this is Gauss-Seidel.
+ *
+ * For the model problem, the optimal relaxation factor follows from the spectral radius rho of the Jacobi iteration,
+ *
+ * omega = 2 / (1 + sqrt(1 - rho^2)),   rho = sum over x, y, z of (2 c / diagonal) * cos(pi / (nodes - 1))
+ *
+ * with which SOR needs O(N) sweeps instead of the O(N^2) of Jacobi or the explicit time loop.
+ *
+ * The residual used for the convergence check is the one each node had when it was updated, accumulated during the
+ * sweep. It costs no extra pass over the field and a single global reduction per sweep.
+ */
+
+#ifndef REDBLACKSOR_H
+#define REDBLACKSOR_H
+
+#include <cmath>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "Laplacian.h"
+#include "Threading.h"
+
+template<typename floatT>
+class RedBlackSOR
+{
+public:
+    /**
+     * neighbors, chunk and spacing as in main(), nodes is the global number of nodes and offset the global index of
+     * local node (0, 0, 0) in each direction. An omega of zero selects the optimal relaxation factor.
+     */
+    RedBlackSOR(MPI_Comm comm, const int neighbors[NUMBER_OF_DIMENSIONS * 2], const unsigned chunk[NUMBER_OF_DIMENSIONS],
+        const floatT spacing[NUMBER_OF_DIMENSIONS], const unsigned nodes[NUMBER_OF_DIMENSIONS],
+        const unsigned offset[NUMBER_OF_DIMENSIONS], floatT omega = 0.0)
+        : op_(comm, neighbors, chunk, spacing)
+    {
+        const floatT pi = std::acos(floatT(-1.0));
+        floatT rho = 0.0;
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+            rho += 2.0 * op_.coefficient(coordinate) / op_.diagonal() * std::cos(pi / (nodes[coordinate] - 1.0));
+        omega_ = omega > 0.0 ? omega : 2.0 / (1.0 + std::sqrt(1.0 - rho * rho));
+        parity_ = static_cast<int>((offset[X] + offset[Y] + offset[Z]) % 2);
+    }
+
+    /// the field updated in place, the solution is swapped in before and out after solve(...)
+    /**
+     * it is empty otherwise, the solver does not hold a copy of the solution.
+     */
+    Field3D<floatT>& solution() { return x_; }
+
+    /// sweep until the L2-norm of the residual dropped by tolerance or maxSweeps were taken, for a zero right hand side
+    /**
+     * returns the number of sweeps taken, solution() is used as the initial guess.
+     */
+    unsigned solve(floatT tolerance, unsigned maxSweeps)
+    {
+        op_.exchange(x_);
+
+        unsigned sweeps = 0;
+        while (sweeps < maxSweeps) {
+            floatT sumOfSquares = 0.0;
+            for (int colour = 0; colour < 2; ++colour) {
+                sumOfSquares += relax(colour);
+                op_.exchange(x_, colour, parity_);
+            }
+            op_.sum(&sumOfSquares, 1);
+            residual_ = std::sqrt(sumOfSquares);
+            if (sweeps == 0)
+                initialResidual_ = residual_;
+            ++sweeps;
+            if (residual_ <= tolerance * initialResidual_)
+                break;
+        }
+        return sweeps;
+    }
+
+    /// L2-norm of the residual during the first and the last sweep of solve(...)
+    floatT initialResidual() const { return initialResidual_; }
+    floatT residual() const { return residual_; }
+
+    floatT omega() const { return omega_; }
+
+private:
+    /// update all unknowns of one colour, returns the local sum of the squared residuals of the nodes counted here
+    floatT relax(int colour)
+    {
+        const floatT cx = op_.coefficient(X), cy = op_.coefficient(Y), cz = op_.coefficient(Z);
+        const floatT diagonal = op_.diagonal();
+        const floatT weight = omega_ / diagonal;
+        const NodeRange& u = op_.unknowns();
+        const NodeRange& o = op_.owned();
+        const int parity = parity_;
+        Field3D<floatT>& x = x_;
+        floatT sumOfSquares = 0.0;
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static) reduction(+:sumOfSquares))
+        for (int i = u.lo[X]; i < u.hi[X]; ++i)
+            for (int j = u.lo[Y]; j < u.hi[Y]; ++j) {
+                floatT* c = &x(i, j, 0);
+                const floatT* west = &x(i - 1, j, 0);
+                const floatT* east = &x(i + 1, j, 0);
+                const floatT* south = &x(i, j - 1, 0);
+                const floatT* north = &x(i, j + 1, 0);
+                const int ownedEnd = i < o.hi[X] && j < o.hi[Y] ? o.hi[Z] : u.lo[Z];
+                const int kBegin = u.lo[Z] + ((colour - i - j - parity - u.lo[Z]) & 1);
+                for (int k = kBegin; k < u.hi[Z]; k += 2) {
+                    const floatT r = -(diagonal * c[k] - cx * (west[k] + east[k]) - cy * (south[k] + north[k]) -
+                        cz * (c[k - 1] + c[k + 1]));
+                    c[k] += weight * r;
+                    if (k < ownedEnd)
+                        sumOfSquares += r * r;
+                }
+            }
+        return sumOfSquares;
+    }
+
+    Laplacian<floatT> op_;
+    Field3D<floatT> x_;
+    floatT omega_;
+    int parity_;
+    floatT initialResidual_ = 0.0;
+    floatT residual_ = 0.0;
+};
+
+#endif
@@ -0,0 +1,267 @@
+/// CPU kernels for the explicit 7-point update of the heat equation on a single sub-domain.
+
+/**
+ * All kernels operate on raw pointers to cell (0, 0, 0) of a Field3D (see Field3D.h) together with its strides. The
+ * innermost loop always runs over k, which is the unit stride direction, and input and output are restrict-qualified
+ * so that the compiler can vectorise the update without having to assume aliasing between T0 and T. The rows of a
+ * box are shared statically among the OpenMP threads, see Threading.h, and each row is updated by the kernel selected
+ * for the instruction set of the CPU, see StencilKernels.h.
+ */
+
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
+#include "Field3D.h"
+#include "StencilKernels.h"
+#include "Threading.h"
+
+/// update T from T0 on the box [iBegin, iEnd) x [jBegin, jEnd) x [kBegin, kEnd), all neighbors must be accessible
+template<typename floatT>
+inline void computeBox(const floatT* HEAT3D_RESTRICT T0, floatT* HEAT3D_RESTRICT T, std::ptrdiff_t strideX,
+    std::ptrdiff_t strideY, int iBegin, int iEnd, int jBegin, int jEnd, int kBegin, int kEnd,
+    floatT Dx, floatT Dy, floatT Dz)
+{
+    const auto update = stencilKernels<floatT>().update;
+
+    HEAT3D_OMP(parallel for collapse(2) schedule(static))
+    for (int i = iBegin; i < iEnd; ++i)
+        for (int j = jBegin; j < jEnd; ++j)
+            update(T0 + i * strideX + j * strideY, T + i * strideX + j * strideY, strideX, strideY, kBegin, kEnd,
+                Dx, Dy, Dz);
+}
+
+/// change of the solution during a timestep, in the maximum and the L2 norm
+/**
+ * the residual used to be calculated in a separate sweep after the update, which reads both T and T0 a second time.
+ * It is now reduced while the stencil is applied, where both values are already in registers.
+ */
+template<typename floatT>
+struct Residual
+{
+    floatT maximum = 0;
+    floatT sumOfSquares = 0;
+
+    void combine(const Residual& other)
+    {
+        maximum = std::max(maximum, other.maximum);
+        sumOfSquares += other.sumOfSquares;
+    }
+
+    floatT l2() const { return std::sqrt(sumOfSquares); }
+};
+
+/// the cells [lo, hi) whose change contributes to the residual, usually the interior 1 <= i, j, k <= size - 2
+struct ResidualBox
+{
+    int lo[3];
+    int hi[3];
+};
+
+/// same as computeBox(...), the change of all cells that are also inside residualBox is added to residual
+/**
+ * each row in k is split into the part inside the residual box, which is updated and reduced, and the parts outside
+ * of it, which are only updated. The reduction is done per thread (and per SIMD lane) and combined at the end.
+ */
+template<typename floatT>
+inline void computeBoxResidual(const floatT* HEAT3D_RESTRICT T0, floatT* HEAT3D_RESTRICT T, std::ptrdiff_t strideX,
+    std::ptrdiff_t strideY, int iBegin, int iEnd, int jBegin, int jEnd, int kBegin, int kEnd,
+    floatT Dx, floatT Dy, floatT Dz, const ResidualBox& residualBox, Residual<floatT>& residual)
+{
+    const auto update = stencilKernels<floatT>().update;
+    const auto updateResidual = stencilKernels<floatT>().updateResidual;
+    floatT maximum = residual.maximum;
+    floatT sumOfSquares = residual.sumOfSquares;
+
+    HEAT3D_OMP(parallel for collapse(2) reduction(max : maximum) reduction(+ : sumOfSquares) schedule(static))
+    for (int i = iBegin; i < iEnd; ++i)
+        for (int j = jBegin; j < jEnd; ++j) {
+            const floatT* c = T0 + i * strideX + j * strideY;
+            floatT* t = T + i * strideX + j * strideY;
+
+            const bool counted = i >= residualBox.lo[0] && i < residualBox.hi[0] &&
+                j >= residualBox.lo[1] && j < residualBox.hi[1];
+            const int kFirst = counted ? std::min(std::max(residualBox.lo[2], kBegin), kEnd) : kEnd;
+            const int kLast = counted ? std::min(std::max(residualBox.hi[2], kFirst), kEnd) : kEnd;
+
+            update(c, t, strideX, strideY, kBegin, kFirst, Dx, Dy, Dz);
+            updateResidual(c, t, strideX, strideY, kFirst, kLast, Dx, Dy, Dz, maximum, sumOfSquares);
+            update(c, t, strideX, strideY, kLast, kEnd, Dx, Dy, Dz);
+        }
+
+    residual.maximum = maximum;
+    residual.sumOfSquares = sumOfSquares;
+}
+
+/// the interior 1 <= i, j, k <= size - 2 of a sub-domain, over which the residual is calculated
+template<typename floatT>
+inline ResidualBox interiorResidualBox(const Field3D<floatT>& field)
+{
+    return ResidualBox{
+        { 1, 1, 1 },
+        { static_cast<int>(field.size(0)) - 1, static_cast<int>(field.size(1)) - 1, static_cast<int>(field.size(2)) - 1 }
+    };
+}
+
+/// add the change from before to after on the interior of a sub-domain to residual
+/**
+ * for the integrators which do not update the interior with the stencil above, see SuperTimeStepping.h and
+ * ImplicitTimeStepping.h.
+ */
+template<typename floatT>
+inline void reduceChange(const Field3D<floatT>& before, const Field3D<floatT>& after, Residual<floatT>& residual)
+{
+    const ResidualBox box = interiorResidualBox(after);
+    floatT maximum = residual.maximum;
+    floatT sumOfSquares = residual.sumOfSquares;
+
+    HEAT3D_OMP(parallel for collapse(2) reduction(max : maximum) reduction(+ : sumOfSquares) schedule(static))
+    for (int i = box.lo[0]; i < box.hi[0]; ++i)
+        for (int j = box.lo[1]; j < box.hi[1]; ++j) {
+            const floatT* t0 = &before(i, j, 0);
+            const floatT* t = &after(i, j, 0);
+            for (int k = box.lo[2]; k < box.hi[2]; ++k) {
+                const floatT change = std::fabs(t[k] - t0[k]);
+                maximum = std::max(maximum, change);
+                sumOfSquares += change * change;
+            }
+        }
+    residual.maximum = maximum;
+    residual.sumOfSquares = sumOfSquares;
+}
+
+/// update all cells of the sub-domain that do not require any halo information, i.e. 1 <= i, j, k <= size - 2
+/**
+ * if residual is given, the change of all updated cells is added to it
+ */
+template<typename floatT>
+inline void computeInterior(const Field3D<floatT>& T0, Field3D<floatT>& T, floatT Dx, floatT Dy, floatT Dz,
+    Residual<floatT>* residual = nullptr)
+{
+    if (residual)
+        computeBoxResidual(T0.origin(), T.origin(), T0.strideX(), T0.strideY(),
+            1, static_cast<int>(T0.size(0)) - 1, 1, static_cast<int>(T0.size(1)) - 1, 1, static_cast<int>(T0.size(2)) - 1,
+            Dx, Dy, Dz, interiorResidualBox(T0), *residual);
+    else
+        computeBox(T0.origin(), T.origin(), T0.strideX(), T0.strideY(),
+            1, static_cast<int>(T0.size(0)) - 1, 1, static_cast<int>(T0.size(1)) - 1, 1, static_cast<int>(T0.size(2)) - 1,
+            Dx, Dy, Dz);
+}
+
+/// extent of a tile in the j and k direction, the i direction is always swept completely
+struct TileSize
+{
+    int j;
+    int k;
+};
+
+/// size (in bytes) of the cache the tiles should fit into, the L2 cache if the system tells us, otherwise 256 KiB
+inline std::size_t tileCacheSize()
+{
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+    long cacheSize = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (cacheSize > 0)
+        return static_cast<std::size_t>(cacheSize);
+#endif
+    return 256 * 1024;
+}
+
+/// choose a tile size such that the three T0 planes (i - 1, i, i + 1) and the T plane of one tile fit into the cache
+/**
+ * splitting k shortens the unit stride streams and hurts vectorisation and hardware prefetching, so rows are kept
+ * complete unless not even a handful of them fits into the cache. The j extent is then chosen to fill the cache.
+ */
+template<typename floatT>
+inline TileSize defaultTileSize(unsigned sizeY, unsigned sizeZ, std::size_t cacheSize = tileCacheSize())
+{
+    const int interiorJ = std::max(static_cast<int>(sizeY) - 2, 1);
+    const int interiorK = std::max(static_cast<int>(sizeZ) - 2, 1);
+    const int minimumRows = 8;
+    const std::size_t bytesPerCell = 4 * sizeof(floatT);
+
+    TileSize tile;
+    tile.k = std::max(1, std::min(interiorK, static_cast<int>(cacheSize / (bytesPerCell * minimumRows))));
+    tile.j = static_cast<int>(cacheSize / (bytesPerCell * static_cast<std::size_t>(tile.k)));
+    tile.j = std::max(1, std::min(interiorJ, tile.j));
+    return tile;
+}
+
+/// same as computeInterior(...), but the j-k plane is split into tiles which are each swept through all i
+/**
+ * once the sub-domain no longer fits into the cache, an untiled sweep has to reload the i - 1 and i + 1 planes from
+ * main memory. Within a tile, those planes are still cache resident when they are needed again.
+ */
+template<typename floatT>
+inline void computeInteriorTiled(const Field3D<floatT>& T0, Field3D<floatT>& T, floatT Dx, floatT Dy, floatT Dz,
+    TileSize tile, Residual<floatT>* residual = nullptr)
+{
+    const int iEnd = static_cast<int>(T0.size(0)) - 1;
+    const int jEnd = static_cast<int>(T0.size(1)) - 1;
+    const int kEnd = static_cast<int>(T0.size(2)) - 1;
+    const ResidualBox residualBox = interiorResidualBox(T0);
+
+    for (int jTile = 1; jTile < jEnd; jTile += tile.j)
+        for (int kTile = 1; kTile < kEnd; kTile += tile.k)
+            if (residual)
+                computeBoxResidual(T0.origin(), T.origin(), T0.strideX(), T0.strideY(), 1, iEnd,
+                    jTile, std::min(jTile + tile.j, jEnd), kTile, std::min(kTile + tile.k, kEnd), Dx, Dy, Dz,
+                    residualBox, *residual);
+            else
+                computeBox(T0.origin(), T.origin(), T0.strideX(), T0.strideY(), 1, iEnd,
+                    jTile, std::min(jTile + tile.j, jEnd), kTile, std::min(kTile + tile.k, kEnd), Dx, Dy, Dz);
+}
+
+/// wall clock time (in seconds) of the untiled and the tiled interior sweep on a sub-domain of the given size
+struct TilingBenchmark
+{
+    double untiled;
+    double tiled;
+};
+
+template<typename floatT>
+inline TilingBenchmark benchmarkTiling(unsigned sizeX, unsigned sizeY, unsigned sizeZ, TileSize tile,
+    unsigned repetitions)
+{
+    Field3D<floatT> T0(sizeX, sizeY, sizeZ), T(sizeX, sizeY, sizeZ);
+    for (unsigned i = 0; i < sizeX; ++i)
+        for (unsigned j = 0; j < sizeY; ++j)
+            for (unsigned k = 0; k < sizeZ; ++k)
+                T0(i, j, k) = static_cast<floatT>(i + j + k);
+
+    const floatT D = static_cast<floatT>(0.1);
+    TilingBenchmark result = { 0.0, 0.0 };
+
+    /// warm up once, then alternate both variants so that neither benefits from the state the other left behind
+    computeInterior(T0, T, D, D, D);
+    for (unsigned repetition = 0; repetition < repetitions; ++repetition) {
+        auto start = std::chrono::steady_clock::now();
+        computeInterior(T0, T, D, D, D);
+        auto middle = std::chrono::steady_clock::now();
+        computeInteriorTiled(T0, T, D, D, D, tile);
+        auto end = std::chrono::steady_clock::now();
+
+        result.untiled += std::chrono::duration<double>(middle - start).count();
+        result.tiled += std::chrono::duration<double>(end - middle).count();
+    }
+    return result;
+}
+
+/// minimum number of bytes moved from and to main memory by one call to computeInterior(...)
+/**
+ * assuming perfect cache reuse of the neighboring planes, each interior cell is read once from T0 and written once to
+ * T. This is the figure used to report the achieved memory bandwidth.
+ */
+template<typename floatT>
+inline double interiorBytes(const Field3D<floatT>& field)
+{
+    return 2.0 * sizeof(floatT) * (field.size(0) - 2.0) * (field.size(1) - 2.0) * (field.size(2) - 2.0);
+}
+
+#endif
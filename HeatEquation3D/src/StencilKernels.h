@@ -0,0 +1,336 @@
+/// row kernels of the 7-point update for several instruction set levels, selected at runtime.
+
+/**
+ * The build does not pass any architecture flags, so that the same executable runs on all node generations, which
+ * leaves the compiler with SSE2. Here, the update of one row in k (the unit stride direction) is additionally compiled
+ * with AVX2 and AVX-512 intrinsics, and the best variant the CPU supports (as reported by CPUID) is chosen at startup.
+ * computeBox(...) and computeBoxResidual(...) in Stencil.h call the selected row kernel for each row of a box, so the
+ * interior sweep and the temporally blocked sweep use it, and so do the faces with rows in k (see Face.h).
+ *
+ * The vector kernels evaluate the update with exactly the same operations in the same order as the scalar one (no
+ * fused multiply-add), so the solution is bit-identical for every kernel. Only the order in which the sum of squares
+ * of the residual is accumulated differs. As the AVX-512 target implies FMA, and GCC contracts multiplications and
+ * additions across statements by default (-ffp-contract=fast in its GNU modes), CMakeLists.txt compiles heat3D_cpu with
+ * -ffp-contract=off, and Clang is told so by HEAT3D_NO_FP_CONTRACT. Every kernel is checked against the scalar one
+ * before it is used, see verifyStencilKernels(...), so a vector kernel built without the flag is rejected rather than
+ * changing the solution.
+ *
+ * The vector variants are only available for double precision on x86 compilers that support the target attribute
+ * (GCC, Clang), otherwise the scalar kernel is the only one.
+ */
+
+#ifndef STENCILKERNELS_H
+#define STENCILKERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Field3D.h"
+#include "Threading.h"
+
+#if defined(_MSC_VER)
+#define HEAT3D_RESTRICT __restrict
+#else
+#define HEAT3D_RESTRICT __restrict__
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(__CUDACC__)
+#define HEAT3D_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/// keep Clang (which only contracts within an expression) from fusing the multiplications and additions of a kernel,
+/// placed at the start of the function body. GCC is given -ffp-contract=off by the build, see above.
+#if defined(__clang__)
+#define HEAT3D_NO_FP_CONTRACT _Pragma("clang fp contract(off)")
+#else
+#define HEAT3D_NO_FP_CONTRACT
+#endif
+
+/// update the row T[kBegin, kEnd) from T0, c and t point to k = 0 of the row in T0 and T
+template<typename floatT>
+inline void updateRowScalar(const floatT* HEAT3D_RESTRICT c, floatT* HEAT3D_RESTRICT t, std::ptrdiff_t strideX,
+    std::ptrdiff_t strideY, int kBegin, int kEnd, floatT Dx, floatT Dy, floatT Dz)
+{
+    HEAT3D_NO_FP_CONTRACT
+    for (int k = kBegin; k < kEnd; ++k)
+        t[k] = c[k] +
+            Dx * (c[k + strideX] - 2.0 * c[k] + c[k - strideX]) +
+            Dy * (c[k + strideY] - 2.0 * c[k] + c[k - strideY]) +
+            Dz * (c[k + 1] - 2.0 * c[k] + c[k - 1]);
+}
+
+/// same as updateRowScalar(...), the change of each cell is reduced into maximum and sumOfSquares
+template<typename floatT>
+inline void updateRowResidualScalar(const floatT* HEAT3D_RESTRICT c, floatT* HEAT3D_RESTRICT t,
+    std::ptrdiff_t strideX, std::ptrdiff_t strideY, int kBegin, int kEnd, floatT Dx, floatT Dy, floatT Dz,
+    floatT& maximum, floatT& sumOfSquares)
+{
+    HEAT3D_NO_FP_CONTRACT
+    floatT rowMaximum = maximum;
+    floatT rowSumOfSquares = sumOfSquares;
+
+    HEAT3D_OMP(simd reduction(max : rowMaximum) reduction(+ : rowSumOfSquares))
+    for (int k = kBegin; k < kEnd; ++k) {
+        const floatT value = c[k] +
+            Dx * (c[k + strideX] - 2.0 * c[k] + c[k - strideX]) +
+            Dy * (c[k + strideY] - 2.0 * c[k] + c[k - strideY]) +
+            Dz * (c[k + 1] - 2.0 * c[k] + c[k - 1]);
+        const floatT change = std::fabs(value - c[k]);
+        t[k] = value;
+        rowMaximum = change > rowMaximum ? change : rowMaximum;
+        rowSumOfSquares += change * change;
+    }
+
+    maximum = rowMaximum;
+    sumOfSquares = rowSumOfSquares;
+}
+
+#if defined(HEAT3D_X86_DISPATCH)
+
+/// the update of four cells, in the same order of operations as updateRowScalar(...)
+__attribute__((target("avx2")))
+inline __m256d updateAVX2(const double* c, std::ptrdiff_t strideX, std::ptrdiff_t strideY, __m256d Dx, __m256d Dy,
+    __m256d Dz)
+{
+    HEAT3D_NO_FP_CONTRACT
+    const __m256d centre = _mm256_loadu_pd(c);
+    const __m256d twoCentre = _mm256_mul_pd(_mm256_set1_pd(2.0), centre);
+    const __m256d x = _mm256_add_pd(_mm256_sub_pd(_mm256_loadu_pd(c + strideX), twoCentre), _mm256_loadu_pd(c - strideX));
+    const __m256d y = _mm256_add_pd(_mm256_sub_pd(_mm256_loadu_pd(c + strideY), twoCentre), _mm256_loadu_pd(c - strideY));
+    const __m256d z = _mm256_add_pd(_mm256_sub_pd(_mm256_loadu_pd(c + 1), twoCentre), _mm256_loadu_pd(c - 1));
+    return _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(centre, _mm256_mul_pd(Dx, x)), _mm256_mul_pd(Dy, y)),
+        _mm256_mul_pd(Dz, z));
+}
+
+__attribute__((target("avx2")))
+inline void updateRowAVX2(const double* HEAT3D_RESTRICT c, double* HEAT3D_RESTRICT t, std::ptrdiff_t strideX,
+    std::ptrdiff_t strideY, int kBegin, int kEnd, double Dx, double Dy, double Dz)
+{
+    HEAT3D_NO_FP_CONTRACT
+    const __m256d vDx = _mm256_set1_pd(Dx), vDy = _mm256_set1_pd(Dy), vDz = _mm256_set1_pd(Dz);
+    int k = kBegin;
+    for (; k + 4 <= kEnd; k += 4)
+        _mm256_storeu_pd(t + k, updateAVX2(c + k, strideX, strideY, vDx, vDy, vDz));
+    updateRowScalar(c, t, strideX, strideY, k, kEnd, Dx, Dy, Dz);
+}
+
+__attribute__((target("avx2")))
+inline void updateRowResidualAVX2(const double* HEAT3D_RESTRICT c, double* HEAT3D_RESTRICT t, std::ptrdiff_t strideX,
+    std::ptrdiff_t strideY, int kBegin, int kEnd, double Dx, double Dy, double Dz, double& maximum,
+    double& sumOfSquares)
+{
+    HEAT3D_NO_FP_CONTRACT
+    const __m256d vDx = _mm256_set1_pd(Dx), vDy = _mm256_set1_pd(Dy), vDz = _mm256_set1_pd(Dz);
+    const __m256d signBit = _mm256_set1_pd(-0.0);
+    __m256d vMaximum = _mm256_set1_pd(maximum);
+    __m256d vSumOfSquares = _mm256_setzero_pd();
+
+    int k = kBegin;
+    for (; k + 4 <= kEnd; k += 4) {
+        const __m256d value = updateAVX2(c + k, strideX, strideY, vDx, vDy, vDz);
+        const __m256d change = _mm256_andnot_pd(signBit, _mm256_sub_pd(value, _mm256_loadu_pd(c + k)));
+        _mm256_storeu_pd(t + k, value);
+        vMaximum = _mm256_max_pd(vMaximum, change);
+        vSumOfSquares = _mm256_add_pd(vSumOfSquares, _mm256_mul_pd(change, change));
+    }
+
+    alignas(32) double lanes[2][4];
+    _mm256_store_pd(lanes[0], vMaximum);
+    _mm256_store_pd(lanes[1], vSumOfSquares);
+    for (int lane = 0; lane < 4; ++lane) {
+        maximum = std::max(maximum, lanes[0][lane]);
+        sumOfSquares += lanes[1][lane];
+    }
+    updateRowResidualScalar(c, t, strideX, strideY, k, kEnd, Dx, Dy, Dz, maximum, sumOfSquares);
+}
+
+/// the update of eight cells, in the same order of operations as updateRowScalar(...)
+__attribute__((target("avx512f")))
+inline __m512d updateAVX512(const double* c, std::ptrdiff_t strideX, std::ptrdiff_t strideY, __m512d Dx, __m512d Dy,
+    __m512d Dz)
+{
+    HEAT3D_NO_FP_CONTRACT
+    const __m512d centre = _mm512_loadu_pd(c);
+    const __m512d twoCentre = _mm512_mul_pd(_mm512_set1_pd(2.0), centre);
+    const __m512d x = _mm512_add_pd(_mm512_sub_pd(_mm512_loadu_pd(c + strideX), twoCentre), _mm512_loadu_pd(c - strideX));
+    const __m512d y = _mm512_add_pd(_mm512_sub_pd(_mm512_loadu_pd(c + strideY), twoCentre), _mm512_loadu_pd(c - strideY));
+    const __m512d z = _mm512_add_pd(_mm512_sub_pd(_mm512_loadu_pd(c + 1), twoCentre), _mm512_loadu_pd(c - 1));
+    return _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(centre, _mm512_mul_pd(Dx, x)), _mm512_mul_pd(Dy, y)),
+        _mm512_mul_pd(Dz, z));
+}
+
+__attribute__((target("avx512f")))
+inline void updateRowAVX512(const double* HEAT3D_RESTRICT c, double* HEAT3D_RESTRICT t, std::ptrdiff_t strideX,
+    std::ptrdiff_t strideY, int kBegin, int kEnd, double Dx, double Dy, double Dz)
+{
+    HEAT3D_NO_FP_CONTRACT
+    const __m512d vDx = _mm512_set1_pd(Dx), vDy = _mm512_set1_pd(Dy), vDz = _mm512_set1_pd(Dz);
+    int k = kBegin;
+    for (; k + 8 <= kEnd; k += 8)
+        _mm512_storeu_pd(t + k, updateAVX512(c + k, strideX, strideY, vDx, vDy, vDz));
+
+    /// the remainder of the row is done with a masked update instead of a scalar loop
+    if (k < kEnd) {
+        const __mmask8 mask = static_cast<__mmask8>((1u << (kEnd - k)) - 1u);
+        const __m512d centre = _mm512_maskz_loadu_pd(mask, c + k);
+        const __m512d twoCentre = _mm512_mul_pd(_mm512_set1_pd(2.0), centre);
+        const __m512d x = _mm512_add_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(mask, c + k + strideX), twoCentre),
+            _mm512_maskz_loadu_pd(mask, c + k - strideX));
+        const __m512d y = _mm512_add_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(mask, c + k + strideY), twoCentre),
+            _mm512_maskz_loadu_pd(mask, c + k - strideY));
+        const __m512d z = _mm512_add_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(mask, c + k + 1), twoCentre),
+            _mm512_maskz_loadu_pd(mask, c + k - 1));
+        _mm512_mask_storeu_pd(t + k, mask, _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(centre, _mm512_mul_pd(vDx, x)),
+            _mm512_mul_pd(vDy, y)), _mm512_mul_pd(vDz, z)));
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void updateRowResidualAVX512(const double* HEAT3D_RESTRICT c, double* HEAT3D_RESTRICT t,
+    std::ptrdiff_t strideX, std::ptrdiff_t strideY, int kBegin, int kEnd, double Dx, double Dy, double Dz,
+    double& maximum, double& sumOfSquares)
+{
+    HEAT3D_NO_FP_CONTRACT
+    const __m512d vDx = _mm512_set1_pd(Dx), vDy = _mm512_set1_pd(Dy), vDz = _mm512_set1_pd(Dz);
+    __m512d vMaximum = _mm512_set1_pd(maximum);
+    __m512d vSumOfSquares = _mm512_setzero_pd();
+
+    int k = kBegin;
+    for (; k + 8 <= kEnd; k += 8) {
+        const __m512d value = updateAVX512(c + k, strideX, strideY, vDx, vDy, vDz);
+        const __m512d change = _mm512_abs_pd(_mm512_sub_pd(value, _mm512_loadu_pd(c + k)));
+        _mm512_storeu_pd(t + k, value);
+        /// same as _mm512_max_pd(...), for which GCC 12 warns about the undefined pass-through operand
+        vMaximum = _mm512_mask_max_pd(vMaximum, 0xFF, vMaximum, change);
+        vSumOfSquares = _mm512_add_pd(vSumOfSquares, _mm512_mul_pd(change, change));
+    }
+
+    alignas(64) double lanes[2][8];
+    _mm512_store_pd(lanes[0], vMaximum);
+    _mm512_store_pd(lanes[1], vSumOfSquares);
+    for (int lane = 0; lane < 8; ++lane) {
+        maximum = std::max(maximum, lanes[0][lane]);
+        sumOfSquares += lanes[1][lane];
+    }
+    updateRowResidualScalar(c, t, strideX, strideY, k, kEnd, Dx, Dy, Dz, maximum, sumOfSquares);
+}
+
+#endif
+
+/// one set of row kernels, see above
+template<typename floatT>
+struct StencilKernels
+{
+    using Update = void (*)(const floatT*, floatT*, std::ptrdiff_t, std::ptrdiff_t, int, int, floatT, floatT, floatT);
+    using UpdateResidual = void (*)(const floatT*, floatT*, std::ptrdiff_t, std::ptrdiff_t, int, int, floatT, floatT,
+        floatT, floatT&, floatT&);
+
+    std::string name;
+    Update update;
+    UpdateResidual updateResidual;
+};
+
+/// all kernels the CPU we run on supports, the scalar one first and the widest one last
+template<typename floatT>
+inline std::vector<StencilKernels<floatT>> availableStencilKernels()
+{
+    return { { "scalar", &updateRowScalar<floatT>, &updateRowResidualScalar<floatT> } };
+}
+
+template<>
+inline std::vector<StencilKernels<double>> availableStencilKernels<double>()
+{
+    std::vector<StencilKernels<double>> kernels = {
+        { "scalar", &updateRowScalar<double>, &updateRowResidualScalar<double> }
+    };
+#if defined(HEAT3D_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back({ "avx2", &updateRowAVX2, &updateRowResidualAVX2 });
+    if (__builtin_cpu_supports("avx512f"))
+        kernels.push_back({ "avx512", &updateRowAVX512, &updateRowResidualAVX512 });
+#endif
+    return kernels;
+}
+
+/// the kernels used by computeBox(...) and computeBoxResidual(...), the scalar ones until others are selected
+template<typename floatT>
+inline StencilKernels<floatT>& stencilKernels()
+{
+    static StencilKernels<floatT> kernels = availableStencilKernels<floatT>().front();
+    return kernels;
+}
+
+/// true if the given kernels reproduce the scalar ones on a small test box
+/**
+ * the updated values and the maximum change have to be identical, only the sum of squares, which is accumulated in a
+ * different order, may differ by the relative tolerance. The row length is chosen such that the vector loops as well
+ * as the remainder handling are exercised.
+ */
+template<typename floatT>
+inline bool verifyStencilKernels(const StencilKernels<floatT>& kernels, double tolerance)
+{
+    const int size[3] = { 5, 6, 37 };
+    Field3D<floatT> T0(size[0], size[1], size[2]), reference(size[0], size[1], size[2]), T(size[0], size[1], size[2]);
+    for (int i = -1; i <= size[0]; ++i)
+        for (int j = -1; j <= size[1]; ++j)
+            for (int k = -1; k <= size[2]; ++k)
+                T0(i, j, k) = static_cast<floatT>(std::sin(0.3 * i + 0.7 * j + 1.1 * k) + 0.01 * k * k);
+
+    const floatT D[3] = { static_cast<floatT>(0.11), static_cast<floatT>(0.07), static_cast<floatT>(0.13) };
+    const StencilKernels<floatT> scalar = availableStencilKernels<floatT>().front();
+
+    bool identical = true;
+    for (int i = 0; i < size[0]; ++i)
+        for (int j = 0; j < size[1]; ++j)
+            for (int kBegin = 0; kBegin < 3; ++kBegin) {
+                floatT* r = &reference(i, j, 0);
+                floatT* t = &T(i, j, 0);
+                const floatT* c = &T0(i, j, 0);
+                floatT maximum[2] = { 0, 0 }, sumOfSquares[2] = { 0, 0 };
+
+                scalar.updateResidual(c, r, T0.strideX(), T0.strideY(), kBegin, size[2] - j, D[0], D[1], D[2],
+                    maximum[0], sumOfSquares[0]);
+                kernels.updateResidual(c, t, T0.strideX(), T0.strideY(), kBegin, size[2] - j, D[0], D[1], D[2],
+                    maximum[1], sumOfSquares[1]);
+                for (int k = kBegin; k < size[2] - j; ++k)
+                    identical = identical && r[k] == t[k];
+                identical = identical && maximum[0] == maximum[1] &&
+                    std::fabs(sumOfSquares[0] - sumOfSquares[1]) <= tolerance * std::fabs(sumOfSquares[0]);
+
+                T.fill(0);
+                kernels.update(c, t, T0.strideX(), T0.strideY(), kBegin, size[2] - j, D[0], D[1], D[2]);
+                for (int k = 0; k < size[2]; ++k)
+                    identical = identical && t[k] == (k >= kBegin && k < size[2] - j ? r[k] : floatT(0));
+            }
+    return identical;
+}
+
+/// select the kernels by name ("scalar", "avx2", "avx512") or, with "auto", the widest one the CPU supports
+/**
+ * kernels that do not reproduce the scalar update are skipped, tolerance is the relative one of the sum of squares
+ * (see verifyStencilKernels(...)). Returns false if the requested kernels are not available, in which case the widest
+ * verified ones are selected instead.
+ */
+template<typename floatT>
+inline bool selectStencilKernels(const std::string& name, double tolerance = 1.0e-12)
+{
+    bool found = false;
+    for (const auto& kernels : availableStencilKernels<floatT>()) {
+        if (!verifyStencilKernels(kernels, tolerance))
+            continue;
+        if (name == "auto" || !found)
+            stencilKernels<floatT>() = kernels;
+        if (kernels.name == name) {
+            stencilKernels<floatT>() = kernels;
+            found = true;
+        }
+    }
+    return found || name == "auto";
+}
+
+#endif
@@ -0,0 +1,227 @@
+/// super-time-stepping with Runge-Kutta-Legendre (RKL2) or Runge-Kutta-Chebyshev (RKC) stages of the explicit step.
+
+/**
+ * A super-step of size tau is made of s stages, each of which is one explicit Euler step E(Y) = Y + dt L(Y) of the time
+ * loop (halo exchange, interior, faces, edges and corners), combined with the previous two stages:
+ *
+ * Y[0] = T[n]
+ * Y[1] = Y[0] + muTilde[1] tau L(Y[0])
+ * Y[j] = mu[j] Y[j-1] + nu[j] Y[j-2] + (1 - mu[j] - nu[j]) Y[0] + muTilde[j] tau L(Y[j-1]) + gammaTilde[j] tau L(Y[0])
+ * T[n+1] = Y[s]
+ *
+ * with tau L(Y) = (tau / dt) (E(Y) - Y). Both schemes are second order accurate and stable as long as tau times the
+ * spectral radius of L stays below the stability boundary beta(s), which grows with s^2:
+ *
+ * RKL2: beta(s) = (s^2 + s - 2) / 2   (Meyer, Balsara and Aslam, 2014)
+ * RKC:  beta(s) = (1 + w0) T''s(w0) / T's(w0) ~ 0.65 s^2,   w0 = 1 + 2 / (13 s^2)   (Sommeijer, Shampine and Verwer, 1997)
+ *
+ * while a single explicit step is stable up to 2. The stage count is chosen as the smallest s for which the super-step
+ * is stable, so one super-step covers O(s^2) explicit steps (about s^2 / 4 at the stability limit of the explicit step
+ * for RKL2, s^2 / 3 for RKC) for the cost of s.
+ *
+ * The stages are combined on the nodes updated by the explicit step only, the boundary values are never touched. The
+ * edges and corners shared with the neighbors, which the time loop extrapolates instead of integrating, are
+ * extrapolated from each combined stage in the same way.
+ * Besides T and T0, four fields are needed: E(Y[0]) and three for the stages in flight.
+ */
+
+#ifndef SUPERTIMESTEPPING_H
+#define SUPERTIMESTEPPING_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "mpi.h"
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "Laplacian.h"
+#include "Stencil.h"
+#include "Threading.h"
+
+template<typename floatT>
+class SuperTimeStepping
+{
+public:
+    enum Method { RKL2, RKC };
+
+    /**
+     * superStep is the size of a super-step in timesteps of the explicit step and radius the spectral radius of
+     * dt L, i.e. 4 (Dx + Dy + Dz). initial has to hold the boundary values, it is copied into the stage fields.
+     */
+    SuperTimeStepping(Method method, floatT superStep, floatT radius, const Field3D<floatT>& initial,
+        const int neighbors[NUMBER_OF_DIMENSIONS * 2])
+        : method_(method), superStep_(superStep), explicitStep0_(initial), stage_{ initial, initial }
+    {
+        stages_ = stagesFor(method, superStep * radius);
+        coefficients(method, stages_);
+
+        for (int coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate) {
+            const int size = static_cast<int>(initial.size(coordinate));
+            updated_.lo[coordinate] = neighbors[2 * coordinate] != MPI_PROC_NULL ? 0 : 1;
+            updated_.hi[coordinate] = neighbors[2 * coordinate + 1] != MPI_PROC_NULL ? size : size - 1;
+        }
+    }
+
+    /// the smallest stage count whose stability boundary is at least radius, at least two
+    static int stagesFor(Method method, floatT radius)
+    {
+        int s = 2;
+        while (stabilityBoundary(method, s) < radius)
+            ++s;
+        return s;
+    }
+
+    /// the largest tau times the spectral radius of L for which s stages are stable
+    static floatT stabilityBoundary(Method method, int s)
+    {
+        if (method == RKL2)
+            return (s * s + s - 2) / 2.0;
+        std::vector<floatT> value, first, second;
+        const floatT w0 = chebyshev(s, value, first, second);
+        return (1.0 + w0) * second[s] / first[s];
+    }
+
+    /// advance y0 by one super-step into y, calling step(from, to) for the explicit step of each stage
+    /**
+     * step(from, to) has to write E(from) on all nodes updated by the stencil of the time loop, extrapolate(field)
+     * fills the edges and corners of a stage. The change of the interior nodes during the super-step is added to
+     * residual, like the interior stencil of the time loop does.
+     */
+    template<typename ExplicitStep, typename Extrapolate>
+    void advance(const Field3D<floatT>& y0, Field3D<floatT>& y, ExplicitStep step, Extrapolate extrapolate,
+        Residual<floatT>* residual)
+    {
+        Field3D<floatT>* buffers[3] = { &y, &stage_[0], &stage_[1] };
+        const Field3D<floatT>* previous2 = &y0;
+        Field3D<floatT>* previous1 = buffers[1];
+
+        step(y0, explicitStep0_);
+        combine(1, y0, y0, y0, *previous1);
+        extrapolate(*previous1);
+
+        for (int j = 2; j <= stages_; ++j) {
+            Field3D<floatT>* next = buffers[j % 3];
+            step(*previous1, *next);
+            combine(j, y0, *previous1, *previous2, *next);
+            extrapolate(*next);
+            previous2 = previous1;
+            previous1 = next;
+        }
+
+        if (previous1 != &y)
+            y.swap(*previous1);
+
+        if (residual)
+            reduceChange(y0, y, *residual);
+    }
+
+    int stages() const { return stages_; }
+    floatT superStep() const { return superStep_; }
+    const char* name() const { return method_ == RKL2 ? "RKL2" : "RKC"; }
+
+private:
+    /// the Chebyshev polynomials T_j(w0) and their first two derivatives for j = 0 ... s, returns w0
+    static floatT chebyshev(int s, std::vector<floatT>& value, std::vector<floatT>& first, std::vector<floatT>& second)
+    {
+        const floatT w0 = 1.0 + 2.0 / (13.0 * s * s);
+        value.assign(s + 1, 0.0);
+        first.assign(s + 1, 0.0);
+        second.assign(s + 1, 0.0);
+        value[0] = 1.0;
+        value[1] = w0;
+        first[1] = 1.0;
+        for (int j = 2; j <= s; ++j) {
+            value[j] = 2.0 * w0 * value[j - 1] - value[j - 2];
+            first[j] = 2.0 * value[j - 1] + 2.0 * w0 * first[j - 1] - first[j - 2];
+            second[j] = 4.0 * first[j - 1] + 2.0 * w0 * second[j - 1] - second[j - 2];
+        }
+        return w0;
+    }
+
+    /// the coefficients mu, nu, muTilde and gammaTilde of all stages
+    void coefficients(Method method, int s)
+    {
+        mu_.assign(s + 1, 0.0);
+        nu_.assign(s + 1, 0.0);
+        muTilde_.assign(s + 1, 0.0);
+        gammaTilde_.assign(s + 1, 0.0);
+        std::vector<floatT> b(s + 1), a(s + 1);
+
+        if (method == RKL2) {
+            const floatT w1 = 4.0 / (s * s + s - 2.0);
+            for (int j = 2; j <= s; ++j)
+                b[j] = (j * j + j - 2.0) / (2.0 * j * (j + 1.0));
+            b[0] = b[1] = b[2];
+            for (int j = 0; j <= s; ++j)
+                a[j] = 1.0 - b[j];
+
+            muTilde_[1] = b[1] * w1;
+            for (int j = 2; j <= s; ++j) {
+                mu_[j] = (2.0 * j - 1.0) / j * b[j] / b[j - 1];
+                nu_[j] = -(j - 1.0) / j * b[j] / b[j - 2];
+                muTilde_[j] = mu_[j] * w1;
+                gammaTilde_[j] = -a[j - 1] * muTilde_[j];
+            }
+            return;
+        }
+
+        std::vector<floatT> value, first, second;
+        const floatT w0 = chebyshev(s, value, first, second);
+        const floatT w1 = first[s] / second[s];
+        for (int j = 2; j <= s; ++j)
+            b[j] = second[j] / (first[j] * first[j]);
+        b[0] = b[1] = b[2];
+        for (int j = 0; j <= s; ++j)
+            a[j] = 1.0 - b[j] * value[j];
+
+        muTilde_[1] = b[1] * w1;
+        for (int j = 2; j <= s; ++j) {
+            mu_[j] = 2.0 * b[j] * w0 / b[j - 1];
+            nu_[j] = -b[j] / b[j - 2];
+            muTilde_[j] = 2.0 * b[j] * w1 / b[j - 1];
+            gammaTilde_[j] = -a[j - 1] * muTilde_[j];
+        }
+    }
+
+    /// stage j from Y[0], Y[j-1], Y[j-2] and E(Y[j-1]), which is held by (and overwritten with) next
+    void combine(int j, const Field3D<floatT>& y0, const Field3D<floatT>& previous1, const Field3D<floatT>& previous2,
+        Field3D<floatT>& next) const
+    {
+        const floatT mu = mu_[j], nu = nu_[j], y0Weight = 1.0 - mu_[j] - nu_[j];
+        const floatT muTilde = muTilde_[j] * superStep_, gammaTilde = gammaTilde_[j] * superStep_;
+        const Field3D<floatT>& e0 = explicitStep0_;
+        const NodeRange& u = updated_;
+        const bool first = j == 1;
+
+        HEAT3D_OMP(parallel for collapse(2) schedule(static))
+        for (int i = u.lo[X]; i < u.hi[X]; ++i)
+            for (int jj = u.lo[Y]; jj < u.hi[Y]; ++jj) {
+                const floatT* start = &y0(i, jj, 0);
+                const floatT* startStep = &e0(i, jj, 0);
+                const floatT* p1 = &previous1(i, jj, 0);
+                const floatT* p2 = &previous2(i, jj, 0);
+                floatT* out = &next(i, jj, 0);
+                if (first) {
+                    HEAT3D_OMP(simd)
+                    for (int k = u.lo[Z]; k < u.hi[Z]; ++k)
+                        out[k] = start[k] + muTilde * (startStep[k] - start[k]);
+                    continue;
+                }
+                HEAT3D_OMP(simd)
+                for (int k = u.lo[Z]; k < u.hi[Z]; ++k)
+                    out[k] = mu * p1[k] + nu * p2[k] + y0Weight * start[k] + muTilde * (out[k] - p1[k]) +
+                        gammaTilde * (startStep[k] - start[k]);
+            }
+    }
+
+    Method method_;
+    floatT superStep_;
+    int stages_;
+    std::vector<floatT> mu_, nu_, muTilde_, gammaTilde_;
+    Field3D<floatT> explicitStep0_;
+    Field3D<floatT> stage_[2];
+    NodeRange updated_;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/// temporally blocked (time skewed wavefront) version of the explicit 7-point update.
+
+/**
+ * A plain sweep reads the whole solution from main memory once per timestep. Here, we advance several timesteps while
+ * the data is still cache resident: the sub-domain is cut into blocks of rows in j, and each block is swept through i
+ * as a wavefront in which plane i of step m is computed right after plane i + 1 of step m - 1. The j range of each step
+ * is shifted by one row per step (time skewing), so that every value a block needs from its predecessor has already
+ * been computed when the block is processed.
+ *
+ * Only the two buffers of the DoubleBuffer are used: step m reads from buffer (m - 1) % 2 and overwrites the value of
+ * step m - 2 in buffer m % 2. The skew of one plane (in i) and one row (in j) per step guarantees that the value of
+ * step m - 2 is no longer needed when it is overwritten. Every cell is updated with exactly the same arithmetic and the
+ * same input values as in the single-step sweep, so the results are bit-identical.
+ *
+ * The region that is updated in step m is [lo, hi) in step 1 and shrinks by shrinkLo / shrinkHi cells per step on the
+ * lower / upper side of each direction. Sides whose values are held fixed (Dirichlet boundaries) do not shrink, sides
+ * that are fed by a deep ghost layer shrink by one cell per step.
+ */
+
+#ifndef TEMPORALBLOCKING_H
+#define TEMPORALBLOCKING_H
+
+#include <algorithm>
+#include <cstddef>
+
+#include "Field3D.h"
+#include "Stencil.h"
+
+/// region updated by a temporal block, see above
+struct TemporalRegion
+{
+    int lo[3];
+    int hi[3];
+    int shrinkLo[3];
+    int shrinkHi[3];
+};
+
+/// number of rows in j per block, such that the planes of both buffers touched by one wavefront fit into the cache
+template<typename floatT>
+inline int defaultTemporalBlockSize(unsigned sizeY, unsigned sizeZ, int steps, std::size_t cacheSize = tileCacheSize())
+{
+    const std::size_t bytesPerRow = 2 * sizeof(floatT) * (steps + 2) * static_cast<std::size_t>(sizeZ);
+    const int rows = static_cast<int>(cacheSize / bytesPerRow) - steps;
+    return std::max(1, std::min(rows, static_cast<int>(sizeY)));
+}
+
+/// advance steps timesteps, starting from the solution in first, the result ends up in buffer steps % 2
+/**
+ * returns true if the final solution is in second, i.e. if steps is odd. In either case, the other buffer holds the
+ * solution of the second to last step (for all cells updated in that step). If residual is given, the change of the
+ * interior cells (see interiorResidualBox(...)) during the last step is added to it.
+ */
+template<typename floatT>
+inline bool advanceTemporalBlock(Field3D<floatT>& first, Field3D<floatT>& second, int steps,
+    const TemporalRegion& region, floatT Dx, floatT Dy, floatT Dz, int blockJ, Residual<floatT>* residual = nullptr)
+{
+    Field3D<floatT>* buffer[2] = { &first, &second };
+    const std::ptrdiff_t strideX = first.strideX();
+    const std::ptrdiff_t strideY = first.strideY();
+    const ResidualBox residualBox = interiorResidualBox(first);
+
+    const int blocks = (region.hi[1] - region.lo[1] + steps - 1 + blockJ - 1) / blockJ;
+    const int wavefronts = region.hi[0] - region.lo[0] + steps - 1;
+
+    for (int block = 0; block < blocks; ++block)
+        for (int wavefront = 0; wavefront < wavefronts; ++wavefront)
+            for (int step = 1; step <= steps; ++step) {
+                const int shift = step - 1;
+                const int i = region.lo[0] + wavefront - shift;
+                if (i < region.lo[0] + shift * region.shrinkLo[0] || i >= region.hi[0] - shift * region.shrinkHi[0])
+                    continue;
+
+                const int jBegin = std::max(region.lo[1] + shift * region.shrinkLo[1],
+                    region.lo[1] + block * blockJ - shift);
+                const int jEnd = std::min(region.hi[1] - shift * region.shrinkHi[1],
+                    region.lo[1] + (block + 1) * blockJ - shift);
+                if (jBegin >= jEnd)
+                    continue;
+
+                const int kBegin = region.lo[2] + shift * region.shrinkLo[2];
+                const int kEnd = region.hi[2] - shift * region.shrinkHi[2];
+
+                if (residual && step == steps)
+                    computeBoxResidual(buffer[(step - 1) % 2]->origin(), buffer[step % 2]->origin(), strideX, strideY,
+                        i, i + 1, jBegin, jEnd, kBegin, kEnd, Dx, Dy, Dz, residualBox, *residual);
+                else
+                    computeBox(buffer[(step - 1) % 2]->origin(), buffer[step % 2]->origin(), strideX, strideY,
+                        i, i + 1, jBegin, jEnd, kBegin, kEnd, Dx, Dy, Dz);
+            }
+
+    return steps % 2 == 1;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/// OpenMP threading of the loops executed by each processor (hybrid MPI + OpenMP).
+
+/**
+ * When compiled with OpenMP, every loop over the cells of a sub-domain is shared among the threads of a processor, so
+ * that one processor per socket or NUMA domain can be used instead of one per core. Without OpenMP, HEAT3D_OMP(...)
+ * expands to nothing and the code is identical to the single threaded version.
+ *
+ * All loops over the sub-domain use a static schedule over the outermost index (i), including the loop in
+ * Field3D::resize(...) that touches the memory first. Each thread therefore keeps working on the planes that were
+ * placed in its own NUMA domain by the first touch policy of the operating system. For this to hold, the threads have
+ * to be pinned, e.g. with OMP_PROC_BIND=close and OMP_PLACES=cores.
+ *
+ * MPI is only ever called by the master thread outside of the parallel regions, so MPI_THREAD_FUNNELED is sufficient.
+ */
+
+#ifndef THREADING_H
+#define THREADING_H
+
+#if defined(_OPENMP)
+#include <omp.h>
+#define HEAT3D_PRAGMA(text) _Pragma(#text)
+#define HEAT3D_OMP(directive) HEAT3D_PRAGMA(omp directive)
+#else
+#define HEAT3D_OMP(directive)
+#endif
+
+/// the level of thread support we need from MPI, see above
+#define HEAT3D_MPI_THREAD_LEVEL MPI_THREAD_FUNNELED
+
+/// number of threads used by each processor
+inline int threadCount()
+{
+#if defined(_OPENMP)
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+#endif
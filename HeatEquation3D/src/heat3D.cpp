@@ -62,9 +62,28 @@ T
 #include <cmath>
 #include <chrono>
 #include <cassert>
+#include <memory>
 #include "mpi.h"
 #include<string>
-#include <cuda.h>
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "DoubleBuffer.h"
+#include "Stencil.h"
+#include "TemporalBlocking.h"
+#include "CommandLine.h"
+#include "DeepHalo.h"
+#include "Face.h"
+#include "HaloExchange.h"
+#include "Multigrid.h"
+#include "ConjugateGradient.h"
+#include "RedBlackSOR.h"
+#include "SuperTimeStepping.h"
+#include "ImplicitTimeStepping.h"
+#include "AdiTimeStepping.h"
+#include "FixedPointAcceleration.h"
+#include "NestedIteration.h"
+#include "FastPoissonSolver.h"
+#include "Threading.h"
 #define DIM_THREAD_BLOCK_X 256
 #define DIM_THREAD_BLOCK_Y 1
 using namespace std;
@@ -86,24 +105,12 @@ using floatT = double;
 #define MPI_FLOAT_T MPI_DOUBLE
 
 
-/// enum used to index over the respective coordinate direction
-enum COORDINATE { X = 0, Y, Z };
+/// COORDINATE, DIRECTION and NUMBER_OF_DIMENSIONS are defined in Cartesian.h
+/// COORDINATEDIRECTIONNUMBER_OF_DIMENSIONSCartesian.hж
 
-/// enum used to access the respective direction on each local processor
-///ڷÿشϵӦö
-/**
- *  0: LEFT
- *  1: RIGHT
- *  2: BOTTOM
- *  3: TOP
- *  4: BACK
- *  5: FRONT
- */
-enum DIRECTION { LEFT = 0, RIGHT, BOTTOM, TOP, BACK, FRONT };
-
-/// the number of physical dimensions, here 3 as we have a 3D domain
-///ߴ3Ϊ3D
-#define NUMBER_OF_DIMENSIONS 3
+/// the default width of the ghost layer surrounding each sub-domain, i.e. the number of halo cells stored per face
+/// ÿΧȣÿ洢ĹεԪ
+#define NUMBER_OF_GHOST_LAYERS 1
 
 int main(int argc, char** argv)
 {
@@ -115,12 +122,11 @@ int main(int argc, char** argv)
 
     int rankDefaultMPICOMM, sizeDefaultMPICOMM;
 
-    /// status and requests for non-blocking communications, i.e. MPI_IAllreduce(...) and MPI_IRecv(...)
-    ///״̬ͷͨŵ󣬼MPI_IAllreduce...MPI_IRecv...
+    /// status and requests for non-blocking communications, i.e. MPI_IAllreduce(...), the halo exchange keeps its own
+    /// requests (see HaloExchange.h)
+    ///״̬ͷͨŵ󣬼MPI_IAllreduce...νԼ󣨲μHaloExchange.h
 
-    MPI_Status  status[NUMBER_OF_DIMENSIONS * 2];
     MPI_Status  postStatus[NUMBER_OF_DIMENSIONS];
-    MPI_Request request[NUMBER_OF_DIMENSIONS * 2];
     MPI_Request reduceRequest;
 
     /// buffers into which we write data that we want to send and receive using MPI
@@ -132,8 +138,10 @@ int main(int argc, char** argv)
     std::array<std::vector<floatT>, NUMBER_OF_DIMENSIONS * 2> sendBuffer;
     std::array<std::vector<floatT>, NUMBER_OF_DIMENSIONS * 2> receiveBuffer;
 
-    /// initialise MPI and get default ranks and size
-    MPI_Init(NULL, NULL);
+    /// initialise MPI and get default ranks and size. Only the master thread communicates (see Threading.h).
+    /// ʼMPIȡĬϵrankʹСֻ߳̽ͨţμThreading.h
+    int threadSupport;
+    MPI_Init_thread(NULL, NULL, HEAT3D_MPI_THREAD_LEVEL, &threadSupport);
     MPI_Comm_rank(MPI_COMM_WORLD, &rankDefaultMPICOMM);
     MPI_Comm_size(MPI_COMM_WORLD, &sizeDefaultMPICOMM);
 
@@ -213,13 +221,67 @@ int main(int argc, char** argv)
      * argv[3]: number of cells in the z direction
      * argv[4]: maximum number of iterations to be used by time loop    ʱѭҪʹõ
      * argv[5]: convergence criterion to be used to check if a solution has converged ׼ڼǷ
+     *
+     * any further argument is optional and has to be given as --name=value (see CommandLine.h):
+     * κǿѡģұ--name=valueʽμCommandLine.h
+     *
+     * --tile-j=N, --tile-k=N:     tile size of the interior stencil, chosen from the cache size if not given
+     * --no-tiling:                sweep the interior without cache blocking
+     * --benchmark-tiling[=N]:     time N untiled and tiled sweeps of the local chunk, report the speedup and exit
+     * --temporal-blocking=N:      advance N timesteps per cache resident block, implies --ghost-width=N
+     * --temporal-tile-j=N:        rows per temporal block, chosen from the cache size if not given
+     * --ghost-width=N:            exchange N cells deep halos once every N timesteps (see DeepHalo.h)
+     * --ghost-model=LATENCY:      predict the best ghost width for a message latency (in s) and exit
+     * --ghost-model-bandwidth=B:  network bandwidth (in bytes/s) used by --ghost-model, default 1e10
+     * --residual-norm=max|l2:     norm of the change per timestep used for the convergence check, default max
+     * --stencil-kernel=NAME:      auto (default), scalar, avx2 or avx512, see StencilKernels.h
+     * --solver=NAME:              explicit (default) time loop, or for the steady state multigrid (see Multigrid.h), cg,
+     *                             pipelined-cg (see ConjugateGradient.h), sor (see RedBlackSOR.h) or the direct solver
+     *                             fft (see FastPoissonSolver.h)
+     * --multigrid-cycle=v|w:      V-cycle (default) or W-cycle
+     * --multigrid-smoothing=N:    Jacobi sweeps before and after each coarse grid correction, default 2
+     * --multigrid-agglomeration=N: gather the coarsest level onto rank 0 if it has at most N nodes, default 32768
+     * --cg-preconditioner=NAME:   jacobi (default) or chebyshev
+     * --chebyshev-degree=N:       degree of the Chebyshev preconditioner, default 4
+     * --sor-omega=W:              relaxation factor of the SOR solver, chosen from the grid size if not given
+     * --integrator=NAME:          euler (default), the super-time-stepping rkl2 or rkc of the explicit time loop, or the
+     *                             implicit backward-euler or crank-nicolson (see ImplicitTimeStepping.h) and adi
+     *                             (see AdiTimeStepping.h)
+     * --super-step=N:             size of a super-step in explicit timesteps, default 100, the stages follow from it
+     * --implicit-step=N:          size of an implicit timestep in explicit timesteps, default 100
+     * --implicit-tolerance=TOL:   drop of the CG residual per implicit timestep, default 1e-6, --cg-preconditioner and
+     *                             --chebyshev-degree apply as well
+     * --adi-step=N:               size of an ADI timestep in explicit timesteps, default 100
+     * --adi-theta=THETA:          implicitness of the ADI scheme from 0.5 (default, second order) to 1
+     * --adi-batches=N:            batches of lines pipelined through the ranks in each ADI sweep, default 4
+     * --acceleration=NAME:        none (default), anderson or aitken extrapolation of the explicit time loop towards
+     *                             the steady state (see FixedPointAcceleration.h)
+     * --acceleration-window=N:    number of previous iterates kept for Anderson mixing, default 10
+     * --acceleration-interval=N:  timesteps between two extrapolations, default 20
+     * --nested-levels=N:          solve on N grids coarsened by 2, 4, ... first and start from the interpolated
+     *                             solution (see NestedIteration.h), default 0
+     * --nested-tolerance=TOL:     drop of the residual on each coarse grid, default 1e-3
+     * --halo=NAME:                persistent (default) or, with an MPI 4 library, partitioned requests for the halo
+     *                             exchange of the explicit timestep, datatype to send and receive the faces in place
+     *                             without packing, neighborhood for a single MPI_Ineighbor_alltoallw or rma to put
+     *                             the faces into a window of the neighbors (see HaloExchange.h)
+     * --benchmark-halo=N:         time N halo exchanges with each of the methods above and stop
+     *
+     * the steady state solvers take ITER_MAX as the maximum number of cycles (or iterations) and stop once the L2-norm
+     * of the residual has dropped by EPS.
+     * ̬ITER_MAXΪѭڲвL2½EPSֹͣ
+     *
+     * when compiled with OpenMP, the number of threads per processor is set with OMP_NUM_THREADS (see Threading.h).
+     * ʹOpenMPʱÿ߳OMP_NUM_THREADSãμThreading.h
      */
+    CommandLine options(argc, argv, 6);
+
     if (rank == 0) {
-        if (argc != 6) {
+        if (argc < 6 || !options.invalid().empty()) {
             std::cout << "Incorrect number of command line arguments specified, use the following syntax:\n" << std::endl;
-            std::cout << "bin/HeatEquation3D NUM_CELLS_X NUM_CELLS_Y NUM_CELLS_Z ITER_MAX EPS" << std::endl;
+            std::cout << "bin/HeatEquation3D NUM_CELLS_X NUM_CELLS_Y NUM_CELLS_Z ITER_MAX EPS [--OPTION=VALUE ...]" << std::endl;
             std::cout << "\nor, using MPI, use the following syntax:\n" << std::endl;
-            std::cout << "mpirun -n NUM_PROCS bin/HeatEquation3D NUM_CELLS_X NUM_CELLS_Y NUM_CELLS_Z ITER_MAX EPS" << std::endl;
+            std::cout << "mpirun -n NUM_PROCS bin/HeatEquation3D NUM_CELLS_X NUM_CELLS_Y NUM_CELLS_Z ITER_MAX EPS [--OPTION=VALUE ...]" << std::endl;
             std::cout << "\nSee source code for additional informations!" << std::endl;
             std::abort();
         }
@@ -232,7 +294,14 @@ int main(int argc, char** argv)
             std::cout << "max number of iterations: " << std::stoi(argv[4]) << std::endl;
 
 
-            std::cout << "convergence threshold:    " << std::stod(argv[5]) << "\n" << std::endl;
+            std::cout << "convergence threshold:    " << std::stod(argv[5]) << std::endl;
+            std::cout << "threads per processor:    " << threadCount() << std::endl;
+            if (threadCount() > 1 && threadSupport < HEAT3D_MPI_THREAD_LEVEL)
+                std::cout << "warning:                  the MPI library does not support MPI_THREAD_FUNNELED" << std::endl;
+            for (const auto& option : options.options())
+                std::cout << "option:                   --" << option.first
+                    << (option.second.empty() ? "" : "=" + option.second) << std::endl;
+            std::cout << std::endl;
 
         }
     }
@@ -311,6 +380,22 @@ int main(int argc, char** argv)
     /// ĵ 
     unsigned finalNumIterations = 0;
 
+    /// time spent in and bytes moved by the interior stencil, used to report the achieved memory bandwidth
+    /// ڲģѵʱƶֽڱʵֵڴ
+    double interiorTime = 0.0;
+    double interiorBytesMoved = 0.0;
+
+    /// the overlap of the halo exchange with the interior: the faces whose halo had already arrived when the interior
+    /// was done, all faces received, and the time spent waiting for the others
+    /// νڲصڲʱѵյԼȴѵʱ
+    double facesArrivedEarly = 0.0;
+    double facesReceived = 0.0;
+    double haloWaitTime = 0.0;
+
+    /// the time simulated by the time loop, used to report the simulated time per wall second
+    /// ʱѭģʱ䣬ڱÿǽʱģʱ
+    double simulatedTime = 0.0;
+
 
     /// assure that the partition given to use by MPI can be used to partition our domain in each direction
   /// ȷMPIʹõķÿ϶ǵз
@@ -330,30 +415,180 @@ int main(int argc, char** argv)
       ((numCells[COORDINATE::Z] - 1) / dimension3D[COORDINATE::Z]) + 1
     };
 
+    /// choose the widest stencil kernel the CPU supports (or the one requested), each is verified against the scalar one
+    /// ѡCPUֵ֧ģںˣںˣÿں˶ں˽֤
+    const std::string stencilKernel = options.get("stencil-kernel", std::string("auto"));
+    const bool stencilKernelFound = selectStencilKernels<floatT>(stencilKernel);
+    if (rank == 0) {
+        if (!stencilKernelFound)
+            std::cout << "The stencil kernel " << stencilKernel << " is not available on this CPU!" << std::endl;
+        std::cout << "Stencil kernel: " << stencilKernels<floatT>().name << " (verified against the scalar kernel)\n"
+            << std::endl;
+    }
 
-    /// Create a solution vector
+    /// tile size used by the interior stencil, either given on the command line or chosen to fit into the cache
+    /// ڲģʹõĿСиҲѡʺϻĴС
+    const bool useTiling = !options.has("no-tiling");
+    TileSize tile = defaultTileSize<floatT>(chunck[COORDINATE::Y], chunck[COORDINATE::Z]);
+    tile.j = std::max(1, options.get("tile-j", tile.j));
+    tile.k = std::max(1, options.get("tile-k", tile.k));
+
+    /// norm of the residual used to check for convergence, both are reduced inside the stencil sweep
+    /// ڼĲв߶ģɨйԼ
+    const std::string residualNorm = options.get("residual-norm", std::string("max"));
+    if (residualNorm != "max" && residualNorm != "l2") {
+        if (rank == 0)
+            std::cout << "Unknown residual norm " << residualNorm << ", use either max or l2!" << std::endl;
+        std::abort();
+    }
+    const bool useL2Residual = residualNorm == "l2";
+
+    /// the solver, either the explicit time loop or one of the steady state solvers, which skip the time loop
+    /// ʽʱѭҲʱѭ̬֮һ
+    const std::string solver = options.get("solver", std::string("explicit"));
+    if (solver != "explicit" && solver != "multigrid" && solver != "cg" && solver != "pipelined-cg" &&
+        solver != "sor" && solver != "fft") {
+        if (rank == 0)
+            std::cout << "Unknown solver " << solver << ", use either explicit, multigrid, cg, pipelined-cg, sor or fft!"
+                << std::endl;
+        std::abort();
+    }
+    const unsigned timeSteps = solver == "explicit" ? iterMax : 0;
+
+    /// the integrator of the time loop, each super-step of rkl2 or rkc is made of several explicit timesteps, while
+    /// backward-euler and crank-nicolson solve a linear system per timestep and adi a tridiagonal system per line
+    /// ʱѭĻrkl2rkcÿɶʽʱ䲽ɣbackward-eulercrank-nicolsonÿʱ䲽һϵͳadiÿһԽϵͳ
+    const std::string integrator = options.get("integrator", std::string("euler"));
+    if (integrator != "euler" && integrator != "rkl2" && integrator != "rkc" && integrator != "backward-euler" &&
+        integrator != "crank-nicolson" && integrator != "adi") {
+        if (rank == 0)
+            std::cout << "Unknown integrator " << integrator
+                << ", use either euler, rkl2, rkc, backward-euler, crank-nicolson or adi!" << std::endl;
+        std::abort();
+    }
+
+    /// width of the ghost layers, i.e. the number of timesteps taken between two halo exchanges. Temporal blocking
+    /// needs the halo data of all timesteps of a block and therefore implies a ghost layer of the same width.
+    /// Ŀȣιν֮ʱ䲽ʱֿҪʱ䲽Ĺݣζͬȵ㡣
+    const unsigned ghostWidth = std::max(1, options.get("ghost-width",
+        std::max(NUMBER_OF_GHOST_LAYERS, options.get("temporal-blocking", 1))));
+    for (unsigned coordinate = 0; coordinate < NUMBER_OF_DIMENSIONS; ++coordinate)
+        if (ghostWidth > 1 && ghostWidth + 2 > chunck[coordinate]) {
+            if (rank == 0)
+                std::cout << "The ghost width has to be smaller than the number of cells per chunk minus one!" << std::endl;
+            std::abort();
+        }
+    if (integrator != "euler" && ghostWidth > 1) {
+        if (rank == 0)
+            std::cout << "The integrator " << integrator << " needs a ghost width of one!" << std::endl;
+        std::abort();
+    }
+
+    /// the extrapolation of the explicit time loop, which works on the iterates of single timesteps
+    /// ʽʱѭƣڵʱ䲽ĵֵ
+    const std::string acceleration = options.get("acceleration", std::string("none"));
+    if (acceleration != "none" && acceleration != "anderson" && acceleration != "aitken") {
+        if (rank == 0)
+            std::cout << "Unknown acceleration " << acceleration << ", use either none, anderson or aitken!"
+                << std::endl;
+        std::abort();
+    }
+    if (acceleration != "none" && (integrator != "euler" || ghostWidth > 1)) {
+        if (rank == 0)
+            std::cout << "The acceleration " << acceleration << " needs the euler integrator with a ghost width of one!"
+                << std::endl;
+        std::abort();
+    }
+
+    /// the requests of the halo exchange of the explicit timestep, which are set up once (see HaloExchange.h)
+    /// ʽʱ䲽νֻһΣμHaloExchange.h
+    const std::string haloMethod = options.get("halo", std::string("persistent"));
+    if (haloMethod != "persistent" && haloMethod != "partitioned" && haloMethod != "datatype" &&
+        haloMethod != "neighborhood" && haloMethod != "rma") {
+        if (rank == 0)
+            std::cout << "Unknown halo exchange " << haloMethod
+                << ", use either persistent, partitioned, datatype, neighborhood or rma!" << std::endl;
+        std::abort();
+    }
+    const auto haloExchangeMethod = haloMethod == "partitioned" ? HaloExchange<floatT>::PARTITIONED :
+        haloMethod == "datatype" ? HaloExchange<floatT>::DATATYPE :
+        haloMethod == "neighborhood" ? HaloExchange<floatT>::NEIGHBORHOOD :
+        haloMethod == "rma" ? HaloExchange<floatT>::ONE_SIDED : HaloExchange<floatT>::PERSISTENT;
+    if (!HaloExchange<floatT>::supported(haloExchangeMethod)) {
+        if (rank == 0)
+            std::cout << "The halo exchange " << haloMethod << " needs an MPI 4 library!" << std::endl;
+        std::abort();
+    }
+    const int temporalBlockJ = std::max(1, options.get("temporal-tile-j",
+        defaultTemporalBlockSize<floatT>(chunck[COORDINATE::Y] + 2 * ghostWidth, chunck[COORDINATE::Z] + 2 * ghostWidth,
+            ghostWidth)));
+
+    /// report the predicted cost of each ghost width for the given network and stop afterwards
+    /// ÿȵԤɱȻֹͣ
+    if (options.has("ghost-model")) {
+        const int repetitions = 10;
+        auto timing = benchmarkTiling<floatT>(chunck[COORDINATE::X], chunck[COORDINATE::Y], chunck[COORDINATE::Z],
+            tile, repetitions);
+        const double timePerCell = std::min(timing.untiled, timing.tiled) / repetitions /
+            ((chunck[COORDINATE::X] - 2.0) * (chunck[COORDINATE::Y] - 2.0) * (chunck[COORDINATE::Z] - 2.0));
+        if (rank == 0) {
+            const double latency = options.get("ghost-model", 1.0e-6);
+            const double bandwidth = options.get("ghost-model-bandwidth", 1.0e10);
+            std::cout << "Ghost width model for a chunk of " << chunck[COORDINATE::X] << " x " << chunck[COORDINATE::Y]
+                << " x " << chunck[COORDINATE::Z] << " cells, latency " << std::scientific << latency << " s, bandwidth "
+                << bandwidth << " bytes/s, " << timePerCell << " s per cell update" << std::endl;
+            unsigned maxWidth = std::min({ chunck[COORDINATE::X], chunck[COORDINATE::Y], chunck[COORDINATE::Z], 18u }) - 2;
+            unsigned best = reportDeepHaloModel(std::cout, chunck, std::max(1u, maxWidth), latency, bandwidth,
+                timePerCell, sizeof(floatT));
+            std::cout << "best ghost width: " << best << std::endl;
+        }
+        MPI_Finalize();
+        return 0;
+    }
 
-    std::vector<std::vector<std::vector<floatT>>> T, T0;
-
-    /// resize both T and T0 for each sub-domain
-    /// ÿTT0ĴС
-    T.resize(chunck[COORDINATE::X]);
-    T0.resize(chunck[COORDINATE::X]);
-    for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i) {
-        T[i].resize(chunck[COORDINATE::Y]);
-        T0[i].resize(chunck[COORDINATE::Y]);
-        for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j) {
-            T[i][j].resize(chunck[COORDINATE::Z]);
-            T0[i][j].resize(chunck[COORDINATE::Z]);
+    /// in benchmark mode, we only compare the tiled against the untiled sweep on the local chunk and stop afterwards
+    /// ڻ׼ģʽ£ǽڱؿϱȽϷֿͲֿɨ裬Ȼֹͣ
+    if (options.has("benchmark-tiling")) {
+        const int repetitions = std::max(1, options.get("benchmark-tiling", 10));
+        auto timing = benchmarkTiling<floatT>(chunck[COORDINATE::X], chunck[COORDINATE::Y], chunck[COORDINATE::Z],
+            tile, repetitions);
+        if (rank == 0) {
+            std::cout << "Tiling benchmark on a chunk of " << chunck[COORDINATE::X] << " x " << chunck[COORDINATE::Y]
+                << " x " << chunck[COORDINATE::Z] << " cells, tile size (j x k): " << tile.j << " x " << tile.k
+                << std::endl;
+            std::cout << "untiled sweep: " << std::scientific << std::setprecision(5)
+                << timing.untiled / repetitions << " s" << std::endl;
+            std::cout << "tiled sweep:   " << std::scientific << std::setprecision(5)
+                << timing.tiled / repetitions << " s" << std::endl;
+            std::cout << "speedup:       " << std::fixed << std::setprecision(2)
+                << timing.untiled / timing.tiled << std::endl;
         }
+        MPI_Finalize();
+        return 0;
     }
 
+
+    /// Create a solution vector
+
+    /**
+     * T and T0 are stored contiguously (see Field3D.h), surrounded by ghost layers into which the halo data of the
+     * neighbors is unpacked after each communication step. Both live in a DoubleBuffer, so that we only exchange their
+     * roles at the beginning of each timestep instead of copying T into T0.
+
+     TT0洢μField3D.hΧ㣬ÿͨŲھӵĹݶС߶λDoubleBufferУ
+     ÿʱ䲽ʼʱֻǵĽɫǽTƵT0С
+     */
+    DoubleBuffer<floatT> solution(chunck[COORDINATE::X], chunck[COORDINATE::Y], chunck[COORDINATE::Z], ghostWidth);
+    Field3D<floatT>& T = solution.current();
+    Field3D<floatT>& T0 = solution.previous();
+
     /// initialise each solution vector on each sub-domain with zero everywhere
     /// ʼÿϵÿ
+    HEAT3D_OMP(parallel for collapse(2) schedule(static))
     for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
         for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
             for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                T[i][j][k] = 0.0;
+                T(i, j, k) = 0.0;
 
     /// apply boundary conditions on the top of the domain
     /// 򶥲Ӧñ߽
@@ -362,7 +597,7 @@ int main(int argc, char** argv)
 
         for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
             for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                T[i][chunck[COORDINATE::Y] - 1][k] = 1.0;
+                T(i, chunck[COORDINATE::Y] - 1, k) = 1.0;
 
     /// apply boundary conditions on the left-side of the domain
       /// Ӧñ߽
@@ -371,7 +606,7 @@ int main(int argc, char** argv)
 
         for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
             for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                T[0][j][k] = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+                T(0, j, k) = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
 
     /// apply boundary conditions on the right-side of the domain
       /// ҲӦñ߽
@@ -380,7 +615,7 @@ int main(int argc, char** argv)
 
         for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
             for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                T[chunck[COORDINATE::X] - 1][j][k] = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+                T(chunck[COORDINATE::X] - 1, j, k) = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
 
     /// apply boundary conditions on the back-side of the domain
       /// ıӦñ߽
@@ -389,7 +624,7 @@ int main(int argc, char** argv)
 
         for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
             for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
-                T[i][j][0] = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+                T(i, j, 0) = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
 
     /// apply boundary conditions on the front-side of the domain
       /// ǰӦñ߽
@@ -398,7 +633,16 @@ int main(int argc, char** argv)
 
         for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
             for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
-                T[i][j][chunck[COORDINATE::Z] - 1] = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+                T(i, j, chunck[COORDINATE::Z] - 1) = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+
+    /// the boundary values never change during the time loop, so both buffers have to hold them from the start
+    /// ֵ߽ʱѭԶı䣬һʼͱ
+    solution.synchronise();
+
+    /// the steady state solvers only work on T, so the storage of T0 is released
+    /// ֻ̬TϹͷT0Ĵ洢ռ
+    if (timeSteps == 0)
+        T0 = Field3D<floatT>();
 
     /// if we use MPI, make sure that our send and recieve buffers are correctly allocated
       /// ʹMPIȷȷķͺͽջ
@@ -477,307 +721,423 @@ int main(int argc, char** argv)
         receiveBuffer[DIRECTION::FRONT].resize(1);
     }
 
-    /// start timing (we don't want any setup time to be included, thus we start it just before the time loop)
-    /// ʼʱǲϣκʱ䣬ʱѭ֮ǰʼʱ
-    auto start = MPI_Wtime();
-
-
-    /// main time loop
-    /**
-     * this is where we solve the actual partial differential equation and do the communication among processors.
-     ʵƫ΢ַ̲д֮ͨŵĵط
-     */
+    /// prepare the tags we need to append to the send message for each send (in each direction) and receive
+    /// ׼ҪΪÿͣÿ򣩸ӵϢıǩ
 
+    for (unsigned index = 0; index < NUMBER_OF_DIMENSIONS * 2; ++index) {
+        tagSend[index] = 100 + neighbors[index];
+        tagReceive[index] = 100 + rank;
+    }
 
+    /// the sends and receives of the halo are set up once with the buffers and tags above and restarted in every
+    /// explicit timestep, the buffers must not be resized from here on
+    /// εķͺͽʹͱǩֻһΣÿʽʱ䲽˺󻺳ٵС
+    std::unique_ptr<HaloExchange<floatT>> halo(new HaloExchange<floatT>(haloExchangeMethod, MPI_COMM_CART, neighbors,
+        chunck, tagSend, tagReceive, sendBuffer, receiveBuffer));
+
+    /// in benchmark mode, we only time the halo exchange with each method the library supports and stop afterwards.
+    /// The first exchange of each method sets up its requests and is not timed.
+    /// ڻ׼ģʽ£ǽԿֵ֧ÿַĹνʱȻֹͣÿַĵһν󣬲ʱ
+    if (options.has("benchmark-halo")) {
+        const int repetitions = std::max(1, options.get("benchmark-halo", 1000));
+        const typename HaloExchange<floatT>::Method methods[] = { HaloExchange<floatT>::PERSISTENT,
+            HaloExchange<floatT>::PARTITIONED, HaloExchange<floatT>::DATATYPE, HaloExchange<floatT>::NEIGHBORHOOD,
+            HaloExchange<floatT>::ONE_SIDED };
+        if (rank == 0)
+            std::cout << "Halo exchange benchmark on a chunk of " << chunck[COORDINATE::X] << " x "
+                << chunck[COORDINATE::Y] << " x " << chunck[COORDINATE::Z] << " cells, time per exchange (max over "
+                << "processors):" << std::endl;
+        for (auto method : methods) {
+            if (!HaloExchange<floatT>::supported(method))
+                continue;
+            HaloExchange<floatT> exchange(method, MPI_COMM_CART, neighbors, chunck, tagSend, tagReceive, sendBuffer,
+                receiveBuffer);
+            double elapsed = 0.0, slowest = 0.0;
+            for (int repetition = -1; repetition < repetitions; ++repetition) {
+                if (repetition == 0) {
+                    MPI_Barrier(MPI_COMM_CART);
+                    elapsed = MPI_Wtime();
+                }
+                exchange.start(T0, T);
+                while (exchange.next() >= 0)
+                    ;
+                exchange.finish();
+            }
+            elapsed = MPI_Wtime() - elapsed;
+            MPI_Allreduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_CART);
+            if (rank == 0)
+                std::cout << std::left << std::setw(14) << std::string(exchange.name()) + ":" << std::right
+                    << std::scientific << std::setprecision(5) << slowest / repetitions << " s" << std::endl;
+        }
+        halo.reset();
+        MPI_Finalize();
+        return 0;
+    }
 
-   
+    /// the residual of the warm start relative to that of T = 0 (see NestedIteration.h), the convergence threshold stays
+    /// relative to the residual of T = 0
+    /// ĲвT = 0ʱвıֵμNestedIteration.hֵT = 0ʱĲв
+    floatT warmStartReduction = 1.0;
 
+    /// find out whether all processors have converged, given the change of the solution during the last timestep
+    /// (reduced by the interior stencil, see Residual in Stencil.h). The residual is always that of the last timestep,
+    /// also if several timesteps were taken at once (see the deep halo path below).
+    /// һʱ䲽нı仯ڲģԼμStencil.hеResidualȷдǷ
+    /// ʹһִ˶ʱ䲽μ·вҲʼһʱ䲽Ĳв
+    auto converged = [&](unsigned time, const Residual<floatT>& residual) -> bool {
+        /// the difference between the current and previous (last time step) solution, in the chosen norm.
+        /// ǰһһ֮Ĳ죬ʹѡķ
 
+        floatT res = std::max(std::numeric_limits<floatT>::min(), useL2Residual ? residual.l2() : residual.maximum);
 
-    for (unsigned time = 0; time < iterMax; ++time)
-    {
-        /// copy the solution from the previous timestep into T, which holds the solution of the last iteration
-          /// ǰһʱ䲽ĽƵTбһεĽ
+        /// if it is the first time step, store the residual as the normalisation factor
+        /// ǵһ򽫲в洢Ϊһ
 
-        for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
-            for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
-                for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                    T0[i][j][k] = T[i][j][k];
 
-        // HALO communication step
+        if (time == 0)
+            if (res != 0.0)
+                norm = res / warmStartReduction;
 
+        /// For MPI, we have to communicate the norm by selecting the lowest among all processors
+        /// MPIǱͨѡдеʹ淶
 
+        if (time == 0) {
+            MPI_Iallreduce(&norm, &globalNorm, 1, MPI_FLOAT_T, MPI_MIN, MPI_COMM_CART, &reduceRequest);
+            MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
+        }
 
-  /// preparing the send buffer (the data we want to send to the left neighbor), if a neighbor exists
-///ھӣ׼ͻҪ͵ھӵݣ
 
-  /**
-   * for simplicity, we write the 2D array (the face on the boundary) into a 1D array which we can easily send.
-   * It is important that once we receive the it we are aware that the array containing the data is 1D now.
+        /// if we want to debug, it may be useful to see the residuals. Turned of for release builds for performance.
+          /// Ҫԣ鿴вܻá Ϊܶ汾
+//#if defined(USE_DEBUG)
+//        if (rank == 0) {
+//            std::cout << "time: " << std::setw(10) << time;
+//            std::cout << std::scientific << std::setw(15) << std::setprecision(5) << ", residual: ";
+//            std::cout << res / norm << std::endl;
+//        }
+//#endif
 
-   Ϊǽ2D飨߽ϵ棩дһ1DУǿɵط Ҫǣһյ
-   Ǿ֪ݵһάġ
-   */
-        unsigned counter = 0;
-        if (neighbors[DIRECTION::LEFT] != MPI_PROC_NULL)
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    sendBuffer[DIRECTION::LEFT][counter++] = T0[1][j][k];
+        /// check if the current residual has dropped below our defined convergence threshold "eps"
+          /// 鵱ǰвǷѽǶֵ eps
+        if (res / norm < eps)
+            breakCondition = true;
 
-        /// preparing the send buffer (the data we want to send to the right neighbor), if a neighbor exists
-        /// ھӣ׼ͻҪ͵ȷھӵݣ
-        counter = 0;
-        if (neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL)
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    sendBuffer[DIRECTION::RIGHT][counter++] = T0[chunck[COORDINATE::X] - 2][j][k];
+        /// Again, for MPI we need to among all processors if we can break from the loop
+        /// ͬMPIǿжѭҪд
 
-        /// preparing the send buffer (the data we want to send to the bottom neighbor), if a neighbor exists
-        /// ھӣ׼ͻҪ͵ײھӵݣ
-        counter = 0;
-        if (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL)
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    sendBuffer[DIRECTION::BOTTOM][counter++] = T0[i][1][k];
 
-        /// preparing the send buffer (the data we want to send to the top neighbor), if a neighbor exists
-        /// ھӣ׼ͻҪ͵ھӵݣ
+        MPI_Iallreduce(&breakCondition, &globalBreakCondition, 1, MPI_INT, MPI_MAX, MPI_COMM_CART, &reduceRequest);
+        MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
 
-        counter = 0;
-        if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL)
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    sendBuffer[DIRECTION::TOP][counter++] = T0[i][chunck[COORDINATE::Y] - 2][k];
+        return globalBreakCondition != 0;
+    };
 
-        /// preparing the send buffer (the data we want to send to the back neighbor), if a neighbor exists
-        /// ھӣ׼ͻҪ͸ھӵݣ
-        counter = 0;
-        if (neighbors[DIRECTION::BACK] != MPI_PROC_NULL)
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    sendBuffer[DIRECTION::BACK][counter++] = T0[i][j][1];
+    /// exchange of ghost layers that are several cells deep, only used with a ghost width larger than one
+    /// Ԫ㽻ȴ1ʱʹ
+    DeepHaloExchange<floatT> deepHalo(MPI_COMM_CART, neighbors, chunck, ghostWidth);
+
+    /// the multigrid hierarchy, only set up if it is used as it holds three fields per level
+    /// νṹʹʱŽΪÿ
+    std::unique_ptr<Multigrid<floatT>> multigrid;
+    if (solver == "multigrid") {
+        Multigrid<floatT>::Settings settings;
+        const std::string cycle = options.get("multigrid-cycle", std::string("v"));
+        if (cycle != "v" && cycle != "w") {
+            if (rank == 0)
+                std::cout << "Unknown multigrid cycle " << cycle << ", use either v or w!" << std::endl;
+            std::abort();
+        }
+        settings.cycleIndex = cycle == "w" ? 2 : 1;
+        settings.smoothing = std::max(1, options.get("multigrid-smoothing", settings.smoothing));
+        settings.agglomeration = options.get("multigrid-agglomeration", static_cast<int>(settings.agglomeration));
+        multigrid.reset(new Multigrid<floatT>(MPI_COMM_CART, dimension3D, coordinates3D, neighbors, chunck, spacing,
+            settings));
+        if (rank == 0) {
+            std::cout << "Multigrid " << (settings.cycleIndex == 2 ? "W" : "V") << "-cycle with "
+                << multigrid->distributedLevels() << " distributed levels" << std::endl;
+            multigrid->describe(std::cout);
+            std::cout << std::endl;
+        }
+    }
 
-        /// preparing the send buffer (the data we want to send to the front neighbor), if a neighbor exists
-        /// ھӣ׼ͻҪ͵ǰھӵݣ
-        counter = 0;
-        if (neighbors[DIRECTION::FRONT] != MPI_PROC_NULL)
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    sendBuffer[DIRECTION::FRONT][counter++] = T0[i][j][chunck[COORDINATE::Z] - 2];
+    /// the Conjugate Gradient solver, classic or pipelined, only set up if it is used
+    /// ݶˮߣʹʱŽ
+    /// (its settings are also used by the implicit integrators)
+    /// Ҳʽ
+    ConjugateGradient<floatT>::Settings cgSettings;
+    const std::string preconditioner = options.get("cg-preconditioner", std::string("jacobi"));
+    if (preconditioner != "jacobi" && preconditioner != "chebyshev") {
+        if (rank == 0)
+            std::cout << "Unknown preconditioner " << preconditioner << ", use either jacobi or chebyshev!" << std::endl;
+        std::abort();
+    }
+    cgSettings.preconditioner = preconditioner == "chebyshev" ? ConjugateGradient<floatT>::CHEBYSHEV :
+        ConjugateGradient<floatT>::JACOBI;
+    cgSettings.chebyshevDegree = std::max(1, options.get("chebyshev-degree", cgSettings.chebyshevDegree));
+    cgSettings.pipelined = solver == "pipelined-cg";
+    std::unique_ptr<ConjugateGradient<floatT>> conjugateGradient;
+    if (solver == "cg" || solver == "pipelined-cg") {
+        conjugateGradient.reset(new ConjugateGradient<floatT>(MPI_COMM_CART, neighbors, chunck, spacing, numCells,
+            cgSettings));
+        if (rank == 0) {
+            std::cout << (cgSettings.pipelined ? "Pipelined " : "") << "Conjugate Gradient with " << preconditioner << " preconditioner";
+            if (cgSettings.preconditioner == ConjugateGradient<floatT>::CHEBYSHEV)
+                std::cout << " of degree " << cgSettings.chebyshevDegree << " on [" << std::scientific
+                    << std::setprecision(5) << conjugateGradient->lambdaMin() << ", "
+                    << conjugateGradient->lambdaMax() << "]";
+            std::cout << "\n" << std::endl;
+        }
+    }
 
+    /// the red-black SOR solver, which updates T in place and holds no field of its own
+    /// SORԭظTԼĳ
+    std::unique_ptr<RedBlackSOR<floatT>> sor;
+    if (solver == "sor") {
+        const unsigned offset[NUMBER_OF_DIMENSIONS] = {
+            coordinates3D[COORDINATE::X] * (chunck[COORDINATE::X] - 1),
+            coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1),
+            coordinates3D[COORDINATE::Z] * (chunck[COORDINATE::Z] - 1)
+        };
+        sor.reset(new RedBlackSOR<floatT>(MPI_COMM_CART, neighbors, chunck, spacing, numCells, offset,
+            options.get("sor-omega", 0.0)));
+        if (rank == 0)
+            std::cout << "Red-black SOR with omega = " << std::fixed << std::setprecision(6) << sor->omega() << "\n"
+                << std::endl;
+    }
 
-       
+    /// the direct solver, which transforms pencils of complete lines in each direction
+    /// ֱÿϱ任ɵǦ
+    std::unique_ptr<FastPoissonSolver<floatT>> fastPoisson;
+    if (solver == "fft") {
+        fastPoisson.reset(new FastPoissonSolver<floatT>(MPI_COMM_CART, dimension3D, coordinates3D, neighbors, chunck,
+            spacing));
+        if (rank == 0)
+            std::cout << "Direct solver with sine transforms of length " << fastPoisson->transformLength(COORDINATE::X)
+                << " x " << fastPoisson->transformLength(COORDINATE::Y) << " x "
+                << fastPoisson->transformLength(COORDINATE::Z)
+#if defined(HEAT3D_USE_FFTW)
+                << " (FFTW)"
+#else
+                << " (built-in FFT)"
+#endif
+                << "\n" << std::endl;
+    }
 
-        /// prepare the tags we need to append to the send message for each send (in each direction) and receive
-        /// ׼ҪΪÿͣÿ򣩸ӵϢıǩ
+    /// the super-time-stepping, the stage count follows from the size of the super-step and the stability of the stages
+    /// ʱ䲽׶ɳĴС͸׶εȶԾ
+    std::unique_ptr<SuperTimeStepping<floatT>> superTimeStepping;
+    if (timeSteps > 0 && (integrator == "rkl2" || integrator == "rkc")) {
+        const floatT superStep = std::max(1.0, options.get("super-step", 100.0));
+        superTimeStepping.reset(new SuperTimeStepping<floatT>(integrator == "rkl2" ? SuperTimeStepping<floatT>::RKL2 :
+            SuperTimeStepping<floatT>::RKC, superStep, 4.0 * (Dx + Dy + Dz), T, neighbors));
+        if (rank == 0)
+            std::cout << "Super-time-stepping with " << superTimeStepping->name() << ": "
+                << superTimeStepping->stages() << " stages per super-step of " << std::fixed << std::setprecision(1)
+                << superStep << " timesteps (" << std::setprecision(2) << superStep / superTimeStepping->stages()
+                << " timesteps per explicit step)\n" << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
 
-        for (unsigned index = 0; index < NUMBER_OF_DIMENSIONS * 2; ++index) {
-            tagSend[index] = 100 + neighbors[index];
-            tagReceive[index] = 100 + rank;
+    /// the implicit integrator, with its own Conjugate Gradient solver for the shifted operator
+    /// ʽλӵĹݶ
+    std::unique_ptr<ImplicitTimeStepping<floatT>> implicitTimeStepping;
+    if (timeSteps > 0 && (integrator == "backward-euler" || integrator == "crank-nicolson")) {
+        const floatT implicitStep = options.get("implicit-step", 100.0);
+        if (implicitStep <= 0.0) {
+            if (rank == 0)
+                std::cout << "The implicit timestep has to be positive!" << std::endl;
+            std::abort();
         }
+        implicitTimeStepping.reset(new ImplicitTimeStepping<floatT>(MPI_COMM_CART, neighbors, chunck, spacing,
+            numCells, implicitStep * dt, alpha, integrator == "backward-euler" ? 1.0 : 0.5, cgSettings,
+            options.get("implicit-tolerance", 1.0e-6), iterMax));
+        if (rank == 0)
+            std::cout << (integrator == "backward-euler" ? "Backward Euler" : "Crank-Nicolson") << " with timesteps of "
+                << implicitStep << " explicit timesteps, solved by Conjugate Gradient with " << preconditioner
+                << " preconditioner\n" << std::endl;
+    }
 
-        /// send the prepared send buffer to the neighbors using non-blocking MPI_Isend(...)
-        /// ʹ÷MPI_Isend...׼õķͻ͸ھ
-        MPI_Isend(&sendBuffer[DIRECTION::LEFT][0], (chunck[COORDINATE::Y] - 1) * (chunck[COORDINATE::Z] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::LEFT], tagSend[DIRECTION::LEFT], MPI_COMM_CART,
-            &request[DIRECTION::LEFT]);
+    /// the ADI integrator, its tridiagonal solves are pipelined through the ranks along each coordinate
+    /// ADIԽÿ귽ڽ̼ˮִ
+    std::unique_ptr<AdiTimeStepping<floatT>> adiTimeStepping;
+    if (timeSteps > 0 && integrator == "adi") {
+        const floatT adiStep = options.get("adi-step", 100.0);
+        const floatT theta = options.get("adi-theta", 0.5);
+        if (adiStep <= 0.0 || theta < 0.5 || theta > 1.0) {
+            if (rank == 0)
+                std::cout << "The ADI timestep has to be positive and theta between 0.5 and 1!" << std::endl;
+            std::abort();
+        }
+        const unsigned offset[NUMBER_OF_DIMENSIONS] = {
+            coordinates3D[COORDINATE::X] * (chunck[COORDINATE::X] - 1),
+            coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1),
+            coordinates3D[COORDINATE::Z] * (chunck[COORDINATE::Z] - 1)
+        };
+        adiTimeStepping.reset(new AdiTimeStepping<floatT>(MPI_COMM_CART, neighbors, chunck, spacing, numCells, offset,
+            adiStep * dt, alpha, theta, options.get("adi-batches", 4)));
+        if (rank == 0)
+            std::cout << "ADI (Douglas, theta = " << theta << ") with timesteps of " << adiStep
+                << " explicit timesteps, " << adiTimeStepping->batches() << " pipelined batches per sweep\n"
+                << std::endl;
+    }
 
-        MPI_Isend(&sendBuffer[DIRECTION::RIGHT][0], (chunck[COORDINATE::Y] - 1) * (chunck[COORDINATE::Z] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::RIGHT], tagSend[DIRECTION::RIGHT], MPI_COMM_CART,
-            &request[DIRECTION::RIGHT]);
+    /// Anderson mixing or Aitken extrapolation of the iterates of the explicit time loop
+    /// ʽʱѭֵAndersonϻAitken
+    std::unique_ptr<FixedPointAcceleration<floatT>> fixedPointAcceleration;
+    if (timeSteps > 0 && acceleration != "none") {
+        fixedPointAcceleration.reset(new FixedPointAcceleration<floatT>(acceleration == "anderson" ?
+            FixedPointAcceleration<floatT>::ANDERSON : FixedPointAcceleration<floatT>::AITKEN, MPI_COMM_CART, neighbors,
+            chunck, options.get("acceleration-window", 10),
+            static_cast<unsigned>(std::max(1, options.get("acceleration-interval", 20)))));
+        if (rank == 0)
+            std::cout << fixedPointAcceleration->name() << " every " << fixedPointAcceleration->interval()
+                << " timesteps with a window of " << fixedPointAcceleration->window() << "\n" << std::endl;
+    }
 
-        MPI_Isend(&sendBuffer[DIRECTION::BOTTOM][0], (chunck[COORDINATE::X] - 1) * (chunck[COORDINATE::Z] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::BOTTOM], tagSend[DIRECTION::BOTTOM], MPI_COMM_CART,
-            &request[DIRECTION::BOTTOM]);
+    /// start timing (we don't want any setup time to be included, thus we start it just before the time loop)
+    /// ʼʱǲϣκʱ䣬ʱѭ֮ǰʼʱ
+    auto start = MPI_Wtime();
 
-        MPI_Isend(&sendBuffer[DIRECTION::TOP][0], (chunck[COORDINATE::X] - 1) * (chunck[COORDINATE::Z] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::TOP], tagSend[DIRECTION::TOP], MPI_COMM_CART,
-            &request[DIRECTION::TOP]);
+    /// the nested iteration replaces the unknowns of T by the interpolated solution of the coarse grids, its time is
+    /// included in the computational time
+    /// Ƕ׵ôĲֵ滻Tδ֪ʱڼʱ
+    const int nestedLevels = options.get("nested-levels", 0);
+    if (nestedLevels > 0) {
+        NestedIteration<floatT> nested(MPI_COMM_CART, coordinates3D, neighbors, chunck, spacing, numCells,
+            nestedLevels);
+        if (nested.levels() < nestedLevels && rank == 0)
+            std::cout << "The grid can only be coarsened " << nested.levels() << " times for the nested iteration"
+                << std::endl;
+        nested.warmStart(T, options.get("nested-tolerance", 1.0e-3), iterMax, rank == 0 ? &std::cout : nullptr);
+        warmStartReduction = nested.reduction(timeSteps > 0 ? useL2Residual : true);
+        if (rank == 0)
+            std::cout << "Warm start residual: " << std::scientific << std::setprecision(5) << warmStartReduction
+                << " of the initial one, " << std::fixed << std::setprecision(6) << MPI_Wtime() - start << " s\n"
+                << std::defaultfloat << std::endl;
+    }
 
-        MPI_Isend(&sendBuffer[DIRECTION::BACK][0], (chunck[COORDINATE::X] - 1) * (chunck[COORDINATE::Y] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::BACK], tagSend[DIRECTION::BACK], MPI_COMM_CART,
-            &request[DIRECTION::BACK]);
+    /// solve for the steady state directly, T holds the boundary values and serves as the initial guess. The fields
+    /// are swapped in and out of the solver, nothing is copied.
+    /// ֱ̬Tֵ߽ʼ²⡣κθơ
+    auto solveSteadyState = [&](auto& steadyState, const char* iteration) {
+        T.swap(steadyState.solution());
+        finalNumIterations = steadyState.solve(eps / warmStartReduction, iterMax);
+        T.swap(steadyState.solution());
+        globalBreakCondition = steadyState.residual() <= eps / warmStartReduction * steadyState.initialResidual();
+        if (rank == 0)
+            std::cout << "Steady state residual: " << std::scientific << std::setprecision(5)
+                << steadyState.initialResidual() << " -> " << steadyState.residual() << ", "
+                << (MPI_Wtime() - start) / std::max(1u, finalNumIterations) << " s per " << iteration << "\n"
+                << std::endl;
+    };
+    if (multigrid)
+        solveSteadyState(*multigrid, "cycle");
+    if (conjugateGradient) {
+        solveSteadyState(*conjugateGradient, "iteration");
+        if (rank == 0)
+            conjugateGradient->report(std::cout, MPI_Wtime() - start);
+    }
+    if (sor)
+        solveSteadyState(*sor, "sweep");
+    if (fastPoisson)
+        solveSteadyState(*fastPoisson, "solve");
+
+
+    /// one explicit timestep from T0 into T without the edges and corners (see extrapolateEdges below), the change of
+    /// the interior is reduced into residual if it is given. Used by the time loop below and by each stage of the
+    /// super-time-stepping (see SuperTimeStepping.h).
+    /// T0Tһʽʱ䲽ߺͽǣμextrapolateEdgesresidualڲı仯ԼС
+    /// ʱѭͳʱ䲽ÿ׶ʹãμSuperTimeStepping.h
+    auto explicitStep = [&](const Field3D<floatT>& T0, Field3D<floatT>& T, Residual<floatT>* residual) {
+        // HALO communication step
 
-        MPI_Isend(&sendBuffer[DIRECTION::FRONT][0], (chunck[COORDINATE::X] - 1) * (chunck[COORDINATE::Y] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::FRONT], tagSend[DIRECTION::FRONT], MPI_COMM_CART,
-            &request[DIRECTION::FRONT]);
+        /// start the receives, then pack the faces of T0 and send them, see HaloExchange.h and Face.h.
+        /// գȻT0沢ͣμHaloExchange.hFace.h
+        halo->start(T0, T);
 
 
         /*****************************************************************************************************************
                                                           GPU BEGIN
    ****************************************************************************************************************/
-        // compute internal domain (no halos required)
-          // ڲΣ
-        
-        
-
-        /// now work on the halo cells
-        /// ڿȦϹ
-
-  /// receive the halo information from each neighbor, if exists.
-/// ÿھӣڣչϢ
-
-        MPI_Recv(&receiveBuffer[DIRECTION::LEFT][0], (chunck[COORDINATE::Y] - 1) * (chunck[COORDINATE::Z] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::LEFT], tagReceive[DIRECTION::LEFT], MPI_COMM_CART,
-            &status[DIRECTION::LEFT]);
-
-        MPI_Recv(&receiveBuffer[DIRECTION::RIGHT][0], (chunck[COORDINATE::Y] - 1) * (chunck[COORDINATE::Z] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::RIGHT], tagReceive[DIRECTION::RIGHT], MPI_COMM_CART,
-            &status[DIRECTION::RIGHT]);
-
-        MPI_Recv(&receiveBuffer[DIRECTION::BOTTOM][0], (chunck[COORDINATE::X] - 1) * (chunck[COORDINATE::Z] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::BOTTOM], tagReceive[DIRECTION::BOTTOM], MPI_COMM_CART,
-            &status[DIRECTION::BOTTOM]);
-
-        MPI_Recv(&receiveBuffer[DIRECTION::TOP][0], (chunck[COORDINATE::X] - 1) * (chunck[COORDINATE::Z] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::TOP], tagReceive[DIRECTION::TOP], MPI_COMM_CART,
-            &status[DIRECTION::TOP]);
-
-        MPI_Recv(&receiveBuffer[DIRECTION::BACK][0], (chunck[COORDINATE::X] - 1) * (chunck[COORDINATE::Y] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::BACK], tagReceive[DIRECTION::BACK], MPI_COMM_CART,
-            &status[DIRECTION::BACK]);
-
-        MPI_Recv(&receiveBuffer[DIRECTION::FRONT][0], (chunck[COORDINATE::X] - 1) * (chunck[COORDINATE::Y] - 1),
-            MPI_FLOAT_T, neighbors[DIRECTION::FRONT], tagReceive[DIRECTION::FRONT], MPI_COMM_CART,
-            &status[DIRECTION::FRONT]);
-
-        /// make sure that all communications have been executed
-        /// ȷͨžִ
-        /**
-         * even though we use a blocking receive here, since we used a non-blocking send, we have to wait for all
-         * communications to have finished before continuing.
-         ʹڴ˴ʹգʹ˷ͣǱȴͨɺܼ
-         */
-        MPI_Waitall(NUMBER_OF_DIMENSIONS * 2, request, status);
-
-        /// now that we have the halo cells, we update the boundaries using information from other processors
-        /// ˹εԪʹϢ±߽
-
-        if (neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::LEFT];
-            unsigned i = 0;
-            unsigned counter = 0;
-
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + THalo[counter++]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
-
-        /// do the same as above, this time for the right neighbor halo data
-        /// ͬĲȷھӹ
-
-        if (neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::RIGHT];
-            unsigned i = chunck[COORDINATE::X] - 1;
-            unsigned counter = 0;
-
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (THalo[counter++] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
-
-        /// do the same as above, this time for the bottom neighbor halo data
-        /// ͬһԵײھӵĹ
-        if (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::BOTTOM];
-            unsigned j = 0;
-            unsigned counter = 0;
-
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + THalo[counter++]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
-
-        /// do the same as above, this time for the top neighbor halo data
-        /// ͬһǶڽĹ
-        if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::TOP];
-            unsigned j = chunck[COORDINATE::Y] - 1;
-            unsigned counter = 0;
-
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (THalo[counter++] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
-
-        /// do the same as above, this time for the back neighbor halo data
-        // ͬһں
-        if (neighbors[DIRECTION::BACK] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::BACK];
-            unsigned k = 0;
-            unsigned counter = 0;
-
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + THalo[counter++]);
-                }
+        // compute internal domain (no halos required), the residual is reduced on the fly
+          // ڲΣͬʱԼв
+        auto interiorStart = MPI_Wtime();
+        if (useTiling)
+            computeInteriorTiled(T0, T, Dx, Dy, Dz, tile, residual);
+        else
+            computeInterior(T0, T, Dx, Dy, Dz, residual);
+        interiorBytesMoved += interiorBytes(T);
+        interiorTime += MPI_Wtime() - interiorStart;
+
+
+        /// now work on the halo cells: the faces whose halo has already arrived are updated first, each of the others
+        /// as soon as its message completes, in whatever order they arrive. The faces do not overlap (the edges are
+        /// extrapolated afterwards), so the order does not change the result. Each face is updated by the same kernel,
+        /// which reads the halo directly from the receive buffer (see Face.h).
+        /// ڴεԪѵȸ£Ϣɺ£˳ޡ滥صƣ
+        /// ˳򲻻ıÿ涼ͬһں˸£ںֱӴӽջȡΣμFace.h
+        int arrived[NUMBER_OF_DIMENSIONS * 2];
+        const int early = halo->arrived(arrived);
+        for (int index = 0; index < early; ++index)
+            computeFace(arrived[index], T0, T, halo->halo(arrived[index]), Dx, Dy, Dz);
+        facesArrivedEarly += early;
+        facesReceived += early;
+
+        for (;;) {
+            const double waitStart = MPI_Wtime();
+            const int direction = halo->next();
+            haloWaitTime += MPI_Wtime() - waitStart;
+            if (direction < 0)
+                break;
+            computeFace(direction, T0, T, halo->halo(direction), Dx, Dy, Dz);
+            facesReceived += 1.0;
         }
 
-        /// do the same as above, this time for the front neighbor halo data
-        /// ͬһǰڹ
-        if (neighbors[DIRECTION::FRONT] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::FRONT];
-            unsigned k = chunck[COORDINATE::Z] - 1;
-            unsigned counter = 0;
-
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (THalo[counter++] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
+        /// the send buffers are packed again in the next timestep, so the sends have to be complete
+        /// ͻһʱ䲽ٴδ˷ͱ
+        halo->finish();
         /************************************************************************************************************
 
                                                                 GPU      END
 
        ***********************************************************************************************************/
+    };
+
+    /// the edges and corners shared with the neighbors are not updated by the stencil but extrapolated from the nodes
+    /// next to them, which completes each explicit timestep. For the super-time-stepping, they are extrapolated after
+    /// every stage, as they are no unknowns of the diffusion equation.
+    /// ھӹıߺͽǲģµģǴԱߵĽڵƵģÿʽʱ䲽ڳʱ䲽
+    /// ÿ׶֮ƣΪǲɢ̵δ֪
+    auto extrapolateEdges = [&](Field3D<floatT>& T) {
         /// update edges of halo elements
         /// ¹ԪصıԵ
         if (neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) {
             if (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) {
                 unsigned i = 0;
                 unsigned j = 0;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    T[i][j][k] = 2.0 * T[i + 1][j][k] - T[i + 2][j][k];
+                    T(i, j, k) = 2.0 * T(i + 1, j, k) - T(i + 2, j, k);
             }
             if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
                 unsigned i = 0;
                 unsigned j = chunck[COORDINATE::Y] - 1;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    T[i][j][k] = 2.0 * T[i + 1][j][k] - T[i + 2][j][k];
+                    T(i, j, k) = 2.0 * T(i + 1, j, k) - T(i + 2, j, k);
             }
             if (neighbors[DIRECTION::BACK] != MPI_PROC_NULL) {
                 unsigned i = 0;
                 unsigned k = 0;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    T[i][j][k] = 2.0 * T[i + 1][j][k] - T[i + 2][j][k];
+                    T(i, j, k) = 2.0 * T(i + 1, j, k) - T(i + 2, j, k);
             }
             if (neighbors[DIRECTION::FRONT] != MPI_PROC_NULL) {
                 unsigned i = 0;
                 unsigned k = chunck[COORDINATE::Z] - 1;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    T[i][j][k] = 2.0 * T[i + 1][j][k] - T[i + 2][j][k];
+                    T(i, j, k) = 2.0 * T(i + 1, j, k) - T(i + 2, j, k);
             }
         }
 
@@ -785,26 +1145,30 @@ int main(int argc, char** argv)
             if (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) {
                 unsigned i = chunck[COORDINATE::X] - 1;
                 unsigned j = 0;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    T[i][j][k] = 2.0 * T[i - 1][j][k] - T[i - 2][j][k];
+                    T(i, j, k) = 2.0 * T(i - 1, j, k) - T(i - 2, j, k);
             }
             if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
                 unsigned i = chunck[COORDINATE::X] - 1;
                 unsigned j = chunck[COORDINATE::Y] - 1;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    T[i][j][k] = 2.0 * T[i - 1][j][k] - T[i - 2][j][k];
+                    T(i, j, k) = 2.0 * T(i - 1, j, k) - T(i - 2, j, k);
             }
             if (neighbors[DIRECTION::BACK] != MPI_PROC_NULL) {
                 unsigned i = chunck[COORDINATE::X] - 1;
                 unsigned k = 0;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    T[i][j][k] = 2.0 * T[i - 1][j][k] - T[i - 2][j][k];
+                    T(i, j, k) = 2.0 * T(i - 1, j, k) - T(i - 2, j, k);
             }
             if (neighbors[DIRECTION::FRONT] != MPI_PROC_NULL) {
                 unsigned i = chunck[COORDINATE::X] - 1;
                 unsigned k = chunck[COORDINATE::Z] - 1;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    T[i][j][k] = 2.0 * T[i - 1][j][k] - T[i - 2][j][k];
+                    T(i, j, k) = 2.0 * T(i - 1, j, k) - T(i - 2, j, k);
             }
         }
 
@@ -812,14 +1176,16 @@ int main(int argc, char** argv)
             if (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) {
                 unsigned j = 0;
                 unsigned k = 0;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                    T[i][j][k] = 2.0 * T[i][j][k + 1] - T[i][j][k + 2];
+                    T(i, j, k) = 2.0 * T(i, j, k + 1) - T(i, j, k + 2);
             }
             if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
                 unsigned j = chunck[COORDINATE::Y] - 1;
                 unsigned k = 0;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                    T[i][j][k] = 2.0 * T[i][j][k + 1] - T[i][j][k + 2];
+                    T(i, j, k) = 2.0 * T(i, j, k + 1) - T(i, j, k + 2);
             }
         }
 
@@ -827,14 +1193,16 @@ int main(int argc, char** argv)
             if (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) {
                 unsigned j = 0;
                 unsigned k = chunck[COORDINATE::Z] - 1;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                    T[i][j][k] = 2.0 * T[i][j][k - 1] - T[i][j][k - 2];
+                    T(i, j, k) = 2.0 * T(i, j, k - 1) - T(i, j, k - 2);
             }
             if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
                 unsigned j = chunck[COORDINATE::Y] - 1;
                 unsigned k = chunck[COORDINATE::Z] - 1;
+                HEAT3D_OMP(parallel for schedule(static))
                 for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                    T[i][j][k] = 2.0 * T[i][j][k - 1] - T[i][j][k - 2];
+                    T(i, j, k) = 2.0 * T(i, j, k - 1) - T(i, j, k - 2);
             }
         }
         /// finished with halo edges extrapolation
@@ -847,7 +1215,7 @@ int main(int argc, char** argv)
             unsigned i = 0;
             unsigned j = 0;
             unsigned k = 0;
-            T[i][j][k] = 1.0 / 3.0 * (T[i + 1][j][k] + T[i][j + 1][k] + T[i][j][k + 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i + 1, j, k) + T(i, j + 1, k) + T(i, j, k + 1));
         }
 
         if ((neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) && (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) &&
@@ -855,7 +1223,7 @@ int main(int argc, char** argv)
             unsigned i = 0;
             unsigned j = 0;
             unsigned k = chunck[COORDINATE::Z] - 1;
-            T[i][j][k] = 1.0 / 3.0 * (T[i + 1][j][k] + T[i][j + 1][k] + T[i][j][k - 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i + 1, j, k) + T(i, j + 1, k) + T(i, j, k - 1));
         }
 
         if ((neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) && (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) &&
@@ -863,7 +1231,7 @@ int main(int argc, char** argv)
             unsigned i = 0;
             unsigned j = chunck[COORDINATE::Y] - 1;
             unsigned k = 0;
-            T[i][j][k] = 1.0 / 3.0 * (T[i + 1][j][k] + T[i][j - 1][k] + T[i][j][k + 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i + 1, j, k) + T(i, j - 1, k) + T(i, j, k + 1));
         }
 
         if ((neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) && (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) &&
@@ -871,7 +1239,7 @@ int main(int argc, char** argv)
             unsigned i = 0;
             unsigned j = chunck[COORDINATE::Y] - 1;
             unsigned k = chunck[COORDINATE::Z] - 1;
-            T[i][j][k] = 1.0 / 3.0 * (T[i + 1][j][k] + T[i][j - 1][k] + T[i][j][k - 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i + 1, j, k) + T(i, j - 1, k) + T(i, j, k - 1));
         }
 
         if ((neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) && (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) &&
@@ -879,7 +1247,7 @@ int main(int argc, char** argv)
             unsigned i = chunck[COORDINATE::X] - 1;
             unsigned j = 0;
             unsigned k = 0;
-            T[i][j][k] = 1.0 / 3.0 * (T[i - 1][j][k] + T[i][j + 1][k] + T[i][j][k + 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i - 1, j, k) + T(i, j + 1, k) + T(i, j, k + 1));
         }
 
         if ((neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) && (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) &&
@@ -887,7 +1255,7 @@ int main(int argc, char** argv)
             unsigned i = chunck[COORDINATE::X] - 1;
             unsigned j = 0;
             unsigned k = chunck[COORDINATE::Z] - 1;
-            T[i][j][k] = 1.0 / 3.0 * (T[i - 1][j][k] + T[i][j + 1][k] + T[i][j][k - 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i - 1, j, k) + T(i, j + 1, k) + T(i, j, k - 1));
         }
 
         if ((neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) && (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) &&
@@ -895,7 +1263,7 @@ int main(int argc, char** argv)
             unsigned i = chunck[COORDINATE::X] - 1;
             unsigned j = chunck[COORDINATE::Y] - 1;
             unsigned k = 0;
-            T[i][j][k] = 1.0 / 3.0 * (T[i - 1][j][k] + T[i][j - 1][k] + T[i][j][k + 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i - 1, j, k) + T(i, j - 1, k) + T(i, j, k + 1));
         }
 
         if ((neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) && (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) &&
@@ -903,70 +1271,95 @@ int main(int argc, char** argv)
             unsigned i = chunck[COORDINATE::X] - 1;
             unsigned j = chunck[COORDINATE::Y] - 1;
             unsigned k = chunck[COORDINATE::Z] - 1;
-            T[i][j][k] = 1.0 / 3.0 * (T[i - 1][j][k] + T[i][j - 1][k] + T[i][j][k - 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i - 1, j, k) + T(i, j - 1, k) + T(i, j, k - 1));
         }
         /// finished with halo corner points
         /// йνǵ
+    };
 
+    /// main time loop
+    /**
+     * this is where we solve the actual partial differential equation and do the communication among processors.
+     ʵƫ΢ַ̲д֮ͨŵĵط
+     */
 
-/// calculate the difference between the current and previous (last time step) solution.
-  /// 㵱ǰһһ֮Ĳ졣
 
-        floatT res = std::numeric_limits<floatT>::min();
-        for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    if (std::fabs(T[i][j][k] - T0[i][j][k]) > res)
-                        res = std::fabs(T[i][j][k] - T0[i][j][k]);
 
-        /// if it is the first time step, store the residual as the normalisation factor
-        /// ǵһ򽫲в洢Ϊһ
+   
 
 
-        if (time == 0)
-            if (res != 0.0)
-                norm = res;
 
-        /// For MPI, we have to communicate the norm by selecting the lowest among all processors
-        /// MPIǱͨѡдеʹ淶
+    for (unsigned time = 0; time < timeSteps; ++time)
+    {
+        /// the solution from the previous timestep becomes T0, T will be overwritten with the new solution
+        /// ǰһʱ䲽ĽΪT0T½⸲
+        solution.swap();
+        Residual<floatT> residual;
+
+        /// with deep ghost layers, the halo is exchanged once and ghostWidth timesteps are taken without communication,
+        /// computing the cells of the ghost layer redundantly (see DeepHalo.h). The first timestep is always done on its
+        /// own to get the norm. Afterwards, T and T0 hold the last two timesteps, so the residual is that of the last one.
+        /// ʹʱֻһΣȻûͨŵִghostWidthʱ䲽ؼĵԪμDeepHalo.h
+        /// һʱ䲽ǵԻ÷֮TT0ʱ䲽˲вһʱ䲽Ĳв
+        if (superTimeStepping || implicitTimeStepping || adiTimeStepping) {
+            if (superTimeStepping) {
+                superTimeStepping->advance(T0, T, [&](const Field3D<floatT>& from, Field3D<floatT>& to) {
+                    explicitStep(from, to, nullptr);
+                }, extrapolateEdges, &residual);
+                simulatedTime += superTimeStepping->superStep() * dt;
+            }
+            else if (implicitTimeStepping) {
+                implicitTimeStepping->advance(T0, T, &residual);
+                simulatedTime += implicitTimeStepping->timestep();
+            }
+            else {
+                adiTimeStepping->advance(T0, T, &residual);
+                simulatedTime += adiTimeStepping->timestep();
+            }
 
-        if (time == 0) {
-            MPI_Iallreduce(&norm, &globalNorm, 1, MPI_FLOAT_T, MPI_MIN, MPI_COMM_CART, &reduceRequest);
-            MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
+            if (converged(time, residual)) {
+                finalNumIterations = time;
+                break;
+            }
+            continue;
         }
 
+        if (ghostWidth > 1) {
+            deepHalo.exchange(T0, T);
+
+            auto interiorStart = MPI_Wtime();
+            const unsigned steps = time == 0 ? 1 : std::min(ghostWidth, iterMax - time);
+            if (!advanceTemporalBlock(T0, T, static_cast<int>(steps), deepHalo.region(), Dx, Dy, Dz, temporalBlockJ,
+                &residual))
+                solution.swap();
+            time += steps - 1;
+            simulatedTime += steps * dt;
+            interiorTime += MPI_Wtime() - interiorStart;
+            interiorBytesMoved += steps * interiorBytes(T);
+
+            if (converged(time, residual)) {
+                finalNumIterations = time;
+                break;
+            }
+            continue;
+        }
 
-        /// if we want to debug, it may be useful to see the residuals. Turned of for release builds for performance.
-          /// Ҫԣ鿴вܻá Ϊܶ汾
-//#if defined(USE_DEBUG)
-//        if (rank == 0) {
-//            std::cout << "time: " << std::setw(10) << time;
-//            std::cout << std::scientific << std::setw(15) << std::setprecision(5) << ", residual: ";
-//            std::cout << res / norm << std::endl;
-//        }
-//#endif
-
-        /// check if the current residual has dropped below our defined convergence threshold "eps"
-          /// 鵱ǰвǷѽǶֵ eps
-        if (res / norm < eps)
-            breakCondition = true;
-
-        /// Again, for MPI we need to among all processors if we can break from the loop
-        /// ͬMPIǿжѭҪд
-
-
-        MPI_Iallreduce(&breakCondition, &globalBreakCondition, 1, MPI_INT, MPI_MAX, MPI_COMM_CART, &reduceRequest);
-        MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
-
-
-        /// final check if we can break, the above was just preparation for this check.
-          /// ǷϢֻ׼ķ
+        explicitStep(T0, T, &residual);
+        extrapolateEdges(T);
+        simulatedTime += dt;
 
 
-        if (globalBreakCondition) {
+        /// check for convergence with the residual reduced by the interior stencil above
+        /// ʹڲģԼĲв
+        if (converged(time, residual)) {
             finalNumIterations = time;
             break;
         }
+
+        /// every few timesteps, T is replaced by the extrapolation of the previous iterates
+        /// ÿʱ䲽T֮ǰֵ
+        if (fixedPointAcceleration)
+            fixedPointAcceleration->update(time, T);
     }
     /// done with the time loop
     /// ʱѭ
@@ -983,8 +1376,44 @@ int main(int argc, char** argv)
         }
         else
             std::cout << "Simulation did not converge within " << iterMax << " iterations." << std::endl;
+        if (timeSteps > 0)
+            std::cout << "Simulated time: " << std::scientific << std::setprecision(5) << simulatedTime << " s, "
+                << simulatedTime / (end - start) << " per wall second" << std::endl;
+        if (implicitTimeStepping)
+            std::cout << "Conjugate Gradient iterations: " << implicitTimeStepping->iterations() << " in "
+                << implicitTimeStepping->timesteps() << " implicit timesteps, " << std::fixed << std::setprecision(1)
+                << static_cast<double>(implicitTimeStepping->iterations()) / implicitTimeStepping->timesteps()
+                << " per timestep" << std::endl;
+        if (fixedPointAcceleration)
+            std::cout << "Extrapolations: " << fixedPointAcceleration->extrapolations() << std::endl;
     }
 
+    /// report the memory bandwidth achieved by the interior stencil, summed over all processors
+    /// ڲģʵֵڴдܺͣ
+    double bandwidth = interiorTime > 0.0 ? interiorBytesMoved / interiorTime / 1.0e9 : 0.0;
+    double globalBandwidth = 0.0;
+    MPI_Iallreduce(&bandwidth, &globalBandwidth, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_CART, &reduceRequest);
+    MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
+    if (rank == 0)
+        std::cout << "Interior stencil bandwidth: " << std::fixed << std::setprecision(2) << globalBandwidth
+            << " GB/s summed over all processors (" << std::setprecision(6) << interiorTime << " s on rank 0)"
+            << std::endl;
+
+    /// report the overlap of the halo exchange with the interior: a face counts as overlapped if its halo had arrived
+    /// by the time the interior was done. The waiting time is that of the slowest processor.
+    /// νڲصһĹڲʱѾΪصȴʱȡĴ
+    double faceCounts[2] = { facesArrivedEarly, facesReceived };
+    double maximumWaitTime = 0.0;
+    MPI_Iallreduce(MPI_IN_PLACE, faceCounts, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_CART, &reduceRequest);
+    MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
+    MPI_Iallreduce(&haloWaitTime, &maximumWaitTime, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_CART, &reduceRequest);
+    MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
+    if (rank == 0 && faceCounts[1] > 0.0)
+        std::cout << "Halo overlap: " << std::fixed << std::setprecision(1) << 100.0 * faceCounts[0] / faceCounts[1]
+            << " % of the faces had arrived when the interior was done, " << std::setprecision(6) << maximumWaitTime
+            << " s waiting for the others (" << std::setprecision(1) << 100.0 * maximumWaitTime / (end - start)
+            << " % of the computational time)" << std::endl;
+
 
     /// calculate the error we have made against the analytic solution
       /// Խ
@@ -994,7 +1423,7 @@ int main(int argc, char** argv)
     for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
         for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
             for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                error += std::sqrt(std::pow(T[i][j][k] - (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y], 2.0));
+                error += std::sqrt(std::pow(T(i, j, k) - (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y], 2.0));
     error /= ((chunck[COORDINATE::X] - 2) * (chunck[COORDINATE::Y] - 2) * (chunck[COORDINATE::Z] - 2));
     MPI_Iallreduce(&error, &globalError, 1, MPI_FLOAT_T, MPI_SUM, MPI_COMM_CART, &reduceRequest);
     MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
@@ -1013,7 +1442,7 @@ int main(int argc, char** argv)
         for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
             for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
                 for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
-                    receiveBufferPostProcess[counter++] = T[i][j][k];
+                    receiveBufferPostProcess[counter++] = T(i, j, k);
 
         MPI_Send(&receiveBufferPostProcess[0], chunck[COORDINATE::X] * chunck[COORDINATE::Y] * chunck[COORDINATE::Z], MPI_FLOAT_T, 0, 200 + rank, MPI_COMM_CART);
         MPI_Send(&coordinates3D[0], NUMBER_OF_DIMENSIONS, MPI_INT, 0, 300 + rank, MPI_COMM_CART);
@@ -1031,7 +1460,7 @@ int main(int argc, char** argv)
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::X] * (chunck[COORDINATE::X] - 1) + i) * spacing[COORDINATE::X];
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::Z] * (chunck[COORDINATE::Z] - 1) + k) * spacing[COORDINATE::Z];
-                    out << std::scientific << std::setprecision(5) << std::setw(15) << T[i][j][k];
+                    out << std::scientific << std::setprecision(5) << std::setw(15) << T(i, j, k);
                     out << std::fixed << std::setw(5) << rank << std::endl;
                 }
 
@@ -1069,12 +1498,15 @@ int main(int argc, char** argv)
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::X] * (chunck[COORDINATE::X] - 1) + i) * spacing[COORDINATE::X];
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::Z] * (chunck[COORDINATE::Z] - 1) + k) * spacing[COORDINATE::Z];
-                    out << std::scientific << std::setprecision(5) << std::setw(15) << T[i][j][k] << std::endl;
+                    out << std::scientific << std::setprecision(5) << std::setw(15) << T(i, j, k) << std::endl;
                 }
         out.close();
     }
 
 
+    /// the persistent requests have to be freed before MPI is finalised
+    /// ־MPI֮ǰͷ
+    halo.reset();
 
     MPI_Finalize();
 
@@ -50,102 +50,84 @@
 #include "mpi.h"
 #include<string>
 #include <cuda.h>
-#include <malloc.h>
-
-#define DIM_THREAD_BLOCK_X 2
-#define DIM_THREAD_BLOCK_Y 1
+#include "Cartesian.h"
+#include "Field3D.h"
+#include "DoubleBuffer.h"
+#include "Face.h"
+#include "Stencil.h"
+
+#define DIM_THREAD_BLOCK_X 32
+#define DIM_THREAD_BLOCK_Y 8
 using namespace std;
 
 
-//method to build 3D pointer
-double*** CreateGrid(int m,int n,int t)
-{
-    int i = 0;
-    int k = 0;
-    double*** result = NULL; 
-    if((m > 0) && (n > 0) && (t > 0))
-    {
-        double** pp = NULL;
-        double* p = NULL;
-        result = (double***)malloc(m * sizeof(double**));     
-        pp = (double**)malloc(m * n * sizeof(double*));      
-        p = (double*)malloc(m * n * t * sizeof(double));     
-        if((result != NULL) && (pp != NULL) && (p != NULL))
-        {
-            for(i = 0;i < m;i++)
-            {
-                result[i] = pp + i * n; 
-                for (k = 0;k < n;k++)
-                {
-                    result[i][k] = p + k * t; 
-                }
-                p = p + n*t;
-            }
-        }
-        else
-        {
-            free(result);
-            free(pp);
-            free(p);
-            result = NULL;
-            pp = NULL;
-            p = NULL;
-        }
-    }
-    return result;
-}
-void FreeGrid(double*** p)
-{
-    if(*p != NULL)
-    {
-        if(**p != NULL)
-        {
-            free(**p);
-            **p = NULL;
-        }
-        free(*p);
-        *p = NULL;
-    }
-    free(p);
-    p = NULL;
-}
-
 /*********************************************************************************************
                                                    GPU kernel methods
 **********************************************************************************************/
 
+/// update the interior of the sub-domain, TBegin and TEnd point to cell (0, 0, 0) of a Field3D-like layout
+/**
+ * each thread owns one (j, k) column and marches through i, so that neighboring threads access neighboring (unit
+ * stride) memory locations in k. The thread block is the j-k tile of the sweep: while marching through i, the values
+ * of the column at i - 1, i and i + 1 are kept in registers, so that each step only has to load the new i + 1 value
+ * instead of re-fetching both neighboring planes from global memory.
+ *
+ * The residual (maximum and sum of squares of the change of each cell) is reduced on the fly: each thread reduces its
+ * column in registers, the thread block reduces those in shared memory and writes one partial result per block into
+ * partialMaximum and partialSumOfSquares, which are combined on the host.
+ */
+__global__  void computeT(const double* __restrict__ TBegin, double* __restrict__ TEnd, int numX, int numY, int numZ,
+    long strideX, long strideY, double Dx, double Dy, double Dz, double* __restrict__ partialMaximum,
+    double* __restrict__ partialSumOfSquares) {
+	__shared__ double blockMaximum[DIM_THREAD_BLOCK_X * DIM_THREAD_BLOCK_Y];
+	__shared__ double blockSumOfSquares[DIM_THREAD_BLOCK_X * DIM_THREAD_BLOCK_Y];
+
+	int k = blockIdx.x * blockDim.x + threadIdx.x + 1;
+	int j = blockIdx.y * blockDim.y + threadIdx.y + 1;
+	double maximum = 0.0;
+	double sumOfSquares = 0.0;
+
+	if (j < numY - 1 && k < numZ - 1) {
+		long index = strideX + j * strideY + k;
+		double below = TBegin[index - strideX];
+		double centre = TBegin[index];
+
+		for (int i = 1; i < numX - 1; ++i) {
+			double above = TBegin[index + strideX];
+			double value = centre +
+				Dx * (above - 2.0 * centre + below) +
+				Dy * (TBegin[index + strideY] - 2.0 * centre + TBegin[index - strideY]) +
+				Dz * (TBegin[index + 1] - 2.0 * centre + TBegin[index - 1]);
+			double change = fabs(value - centre);
+			TEnd[index] = value;
+			maximum = fmax(maximum, change);
+			sumOfSquares += change * change;
+			below = centre;
+			centre = above;
+			index += strideX;
+		}
+	}
 
-__global__  void computeT(double*** TBegin, double ***TEnd, double ***Tres_gpu,int numX, int numY, int numZ, double Dx, double Dy, double Dz) {
-	int i = blockIdx.x * blockDim.x + threadIdx.x;
-	
-	if(i>1&&i<(numX-2)){
-
-	//Distribute data by X direction
-	if(i<(numX)){
-   
-        	for (unsigned j = 1; j < numY - 1; ++j){
-            		for (unsigned k = 1; i < numZ - 1; ++k) {
-                		TEnd[i][j][k] = TBegin[i][j][k] +
-                   		 Dx * (TBegin[i+1][j][k] - 2.0 * TBegin[i][j][k] + TBegin[i-1][j][k] )+
-                   		 Dy * (TBegin[i][j+1][k] - 2.0 * TBegin[i][j][k] + TBegin[i][j-1][k]) +
-                   		 Dz * (TBegin[i][j][k+1] - 2.0 * TBegin[i][j][k] + TBegin[i][j][k-1]);
-				Tres_gpu[i][j][k]=TEnd[i][j][k];
-
-
-            		}
+	int thread = threadIdx.y * blockDim.x + threadIdx.x;
+	blockMaximum[thread] = maximum;
+	blockSumOfSquares[thread] = sumOfSquares;
+	__syncthreads();
 
+	for (int stride = blockDim.x * blockDim.y / 2; stride > 0; stride /= 2) {
+		if (thread < stride) {
+			blockMaximum[thread] = fmax(blockMaximum[thread], blockMaximum[thread + stride]);
+			blockSumOfSquares[thread] += blockSumOfSquares[thread + stride];
 		}
-
-	}
+		__syncthreads();
 	}
 
+	if (thread == 0) {
+		partialMaximum[blockIdx.y * gridDim.x + blockIdx.x] = blockMaximum[0];
+		partialSumOfSquares[blockIdx.y * gridDim.x + blockIdx.x] = blockSumOfSquares[0];
+	}
 }
 
 
-
-
-
-
 // based on compiler flag, use either floats or doubles for floating point operations
 
 
@@ -154,24 +136,10 @@ using floatT = double;
 #define MPI_FLOAT_T MPI_DOUBLE
 
 
-/// enum used to index over the respective coordinate direction
-enum COORDINATE { X = 0, Y, Z };
-
-/// enum used to access the respective direction on each local processor
-
-/**
- *  0: LEFT
- *  1: RIGHT
- *  2: BOTTOM
- *  3: TOP
- *  4: BACK
- *  5: FRONT
- */
-enum DIRECTION { LEFT = 0, RIGHT, BOTTOM, TOP, BACK, FRONT };
-
-/// the number of physical dimensions, here 3 as we have a 3D domain
+/// COORDINATE, DIRECTION and NUMBER_OF_DIMENSIONS are defined in Cartesian.h
 
-#define NUMBER_OF_DIMENSIONS 3
+/// the width of the ghost layer surrounding each sub-domain, i.e. the number of halo cells stored per face
+#define NUMBER_OF_GHOST_LAYERS 1
 
 int main(int argc, char** argv)
 {
@@ -391,25 +359,21 @@ int main(int argc, char** argv)
 
     /// Create a solution vector
 
-    std::vector<std::vector<std::vector<floatT>>> T, T0;
-
-    /// resize both T and T0 for each sub-domain
-      T.resize(chunck[COORDINATE::X]);
-    T0.resize(chunck[COORDINATE::X]);
-    for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i) {
-        T[i].resize(chunck[COORDINATE::Y]);
-        T0[i].resize(chunck[COORDINATE::Y]);
-        for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j) {
-            T[i][j].resize(chunck[COORDINATE::Z]);
-            T0[i][j].resize(chunck[COORDINATE::Z]);
-        }
-    }
+    /**
+     * T and T0 are stored contiguously (see Field3D.h), surrounded by ghost layers into which the halo data of the
+     * neighbors is unpacked after each communication step. Both live in a DoubleBuffer, so that we only exchange their
+     * roles at the beginning of each timestep instead of copying T into T0.
+     */
+    DoubleBuffer<floatT> solution(chunck[COORDINATE::X], chunck[COORDINATE::Y], chunck[COORDINATE::Z],
+        NUMBER_OF_GHOST_LAYERS);
+    Field3D<floatT>& T = solution.current();
+    Field3D<floatT>& T0 = solution.previous();
 
     /// initialise each solution vector on each sub-domain with zero everywhere
        for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
         for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
             for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                T[i][j][k] = 0.0;
+                T(i, j, k) = 0.0;
 
     /// apply boundary conditions on the top of the domain
     
@@ -417,7 +381,7 @@ int main(int argc, char** argv)
 
         for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
             for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                T[i][chunck[COORDINATE::Y] - 1][k] = 1.0;
+                T(i, chunck[COORDINATE::Y] - 1, k) = 1.0;
 
     /// apply boundary conditions on the left-side of the domain
      
@@ -426,7 +390,7 @@ int main(int argc, char** argv)
 
         for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
             for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                T[0][j][k] = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+                T(0, j, k) = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
 
     /// apply boundary conditions on the right-side of the domain
       
@@ -434,7 +398,7 @@ int main(int argc, char** argv)
 
         for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
             for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                T[chunck[COORDINATE::X] - 1][j][k] = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+                T(chunck[COORDINATE::X] - 1, j, k) = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
 
     /// apply boundary conditions on the back-side of the domain
     
@@ -442,7 +406,7 @@ int main(int argc, char** argv)
 
         for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
             for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
-                T[i][j][0] = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+                T(i, j, 0) = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
 
     /// apply boundary conditions on the front-side of the domain
      
@@ -450,7 +414,10 @@ int main(int argc, char** argv)
 
         for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
             for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
-                T[i][j][chunck[COORDINATE::Z] - 1] = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+                T(i, j, chunck[COORDINATE::Z] - 1) = (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
+
+    /// the boundary values never change during the time loop, so both buffers have to hold them from the start
+    solution.synchronise();
 
     /// if we use MPI, make sure that our send and recieve buffers are correctly allocated
     
@@ -522,6 +489,29 @@ int main(int argc, char** argv)
         receiveBuffer[DIRECTION::FRONT].resize(1);
     }
 
+    /// assign a GPU to each process and allocate the device copies of T0 and T
+    int deviceCount;
+    cudaGetDeviceCount(&deviceCount);
+    cudaSetDevice(rank % deviceCount);
+
+    floatT* TBegin;
+    floatT* TEnd;
+    cudaMalloc((void**)&TBegin, sizeof(floatT) * T.allocatedSize());
+    cudaMalloc((void**)&TEnd, sizeof(floatT) * T.allocatedSize());
+
+    /// the kernel only writes interior cells, the boundary values are taken over from the initial solution once
+    cudaMemcpy(TEnd, T.data(), sizeof(floatT) * T.allocatedSize(), cudaMemcpyHostToDevice);
+
+    /// one thread per (j, k) column of the interior, each thread block writes one partial residual
+    dim3 block(DIM_THREAD_BLOCK_X, DIM_THREAD_BLOCK_Y);
+    dim3 grid((chunck[COORDINATE::Z] - 2 + DIM_THREAD_BLOCK_X - 1) / DIM_THREAD_BLOCK_X,
+        (chunck[COORDINATE::Y] - 2 + DIM_THREAD_BLOCK_Y - 1) / DIM_THREAD_BLOCK_Y);
+    const unsigned numBlocks = grid.x * grid.y;
+
+    floatT* partialResidual;
+    cudaMalloc((void**)&partialResidual, sizeof(floatT) * 2 * numBlocks);
+    std::vector<floatT> hostPartialResidual(2 * numBlocks);
+
     /// start timing (we don't want any setup time to be included, thus we start it just before the time loop)
    
     auto start = MPI_Wtime();
@@ -540,72 +530,20 @@ int main(int argc, char** argv)
 
     for (unsigned time = 0; time < iterMax; ++time)
     {
-        /// copy the solution from the previous timestep into T, which holds the solution of the last iteration
-         
-        for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
-            for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
-                for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
-                    T0[i][j][k] = T[i][j][k];
+        /// the solution from the previous timestep becomes T0, T will be overwritten with the new solution
+        solution.swap();
 
         // HALO communication step
 
 
 
-  /// preparing the send buffer (the data we want to send to the left neighbor), if a neighbor exists
-
-
-  /**
-   * for simplicity, we write the 2D array (the face on the boundary) into a 1D array which we can easily send.
-   * It is important that once we receive the it we are aware that the array containing the data is 1D now.
-
-   */
-        unsigned counter = 0;
-        if (neighbors[DIRECTION::LEFT] != MPI_PROC_NULL)
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    sendBuffer[DIRECTION::LEFT][counter++] = T0[1][j][k];
-
-        /// preparing the send buffer (the data we want to send to the right neighbor), if a neighbor exists
-       
-        counter = 0;
-        if (neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL)
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    sendBuffer[DIRECTION::RIGHT][counter++] = T0[chunck[COORDINATE::X] - 2][j][k];
-
-        /// preparing the send buffer (the data we want to send to the bottom neighbor), if a neighbor exists
-                counter = 0;
-        if (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL)
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    sendBuffer[DIRECTION::BOTTOM][counter++] = T0[i][1][k];
-
-        /// preparing the send buffer (the data we want to send to the top neighbor), if a neighbor exists
-      
-
-        counter = 0;
-        if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL)
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    sendBuffer[DIRECTION::TOP][counter++] = T0[i][chunck[COORDINATE::Y] - 2][k];
-
-        /// preparing the send buffer (the data we want to send to the back neighbor), if a neighbor exists
-                counter = 0;
-        if (neighbors[DIRECTION::BACK] != MPI_PROC_NULL)
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    sendBuffer[DIRECTION::BACK][counter++] = T0[i][j][1];
-
-        /// preparing the send buffer (the data we want to send to the front neighbor), if a neighbor exists
-       
-        counter = 0;
-        if (neighbors[DIRECTION::FRONT] != MPI_PROC_NULL)
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    sendBuffer[DIRECTION::FRONT][counter++] = T0[i][j][chunck[COORDINATE::Z] - 2];
+  /// preparing the send buffers (the data we want to send to each neighbor), if a neighbor exists
 
 
-       
+  /// each face is packed by the same kernel, see Face.h.
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+            if (neighbors[direction] != MPI_PROC_NULL)
+                packFace(direction, T0, sendBuffer[direction]);
 
         /// prepare the tags we need to append to the send message for each send (in each direction) and receive
         
@@ -646,74 +584,22 @@ int main(int argc, char** argv)
    ****************************************************************************************************************/
         // compute internal domain (no halos required)
         
-	//Assign GPU to each process
-	int deviceCount;
-
-  	cudaGetDeviceCount(&deviceCount);
-  	int device_id = rank%deviceCount;
-  	cudaSetDevice(device_id); 
-	
-        int numX = chunck[COORDINATE::X];
-        int numY = chunck[COORDINATE::Y];
-        int numZ = chunck[COORDINATE::X];
-	int num = numX*numY*numZ;
-        double ***TBegin = CreateGrid(numX, numY, numZ);
-	double ***TEnd = CreateGrid(numX, numY, numZ);
-	double ***Tres = CreateGrid(numX, numY, numZ);
-	double ***Tres_gpu = CreateGrid(numX, numY, numZ);
-	double ***Thost = CreateGrid(numX, numY, numZ);
-	double ***Thost0 = CreateGrid(numX, numY, numZ);
-       
-	for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i){
-            for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j){
-                for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k){
-                    *(*(*(Thost0 + i) + j) + k)=T0[i][j][k];
-			*(*(*(Thost + i) + j) + k)=T[i][j][k];
-	//printf("Thost0: %f", Thost0[i][j][k]);
-	//printf("\n");
+        /// copy the previous solution to the GPU, update the interior there and copy the result back into T
+        cudaMemcpy(TBegin, T0.data(), sizeof(floatT) * T0.allocatedSize(), cudaMemcpyHostToDevice);
 
+        computeT <<<grid, block>>> (TBegin + T0.originOffset(), TEnd + T.originOffset(), chunck[COORDINATE::X],
+            chunck[COORDINATE::Y], chunck[COORDINATE::Z], T.strideX(), T.strideY(), Dx, Dy, Dz,
+            partialResidual, partialResidual + numBlocks);
 
-		}
-	    }
-	}
-	
-	//malloc memory 
-        cudaMalloc((void**)&TBegin, sizeof(double) * num);
-        cudaMalloc((void**)&TEnd, sizeof(double) * num);
-	cudaMalloc((void**)&Tres_gpu, sizeof(double) * num);
-
-
-        cudaMemcpy(TBegin, Thost0, sizeof(double) * num, cudaMemcpyHostToDevice);
-        cudaMemcpy(TEnd, Thost, sizeof(double) * num, cudaMemcpyHostToDevice);
-	
-	//set grid and block size
-        dim3 block(DIM_THREAD_BLOCK_X, DIM_THREAD_BLOCK_Y);
-        dim3 grid((size_t)ceil((double)(numX-2)/ ((double)DIM_THREAD_BLOCK_X)), 1);
-	
-	//gpu compute kernel
-        computeT <<<grid,block>>> (TBegin, TEnd, Tres_gpu,numX, numY, numZ, Dx, Dy,Dz);
-        
-	//pass data from gpu to cpu
-        cudaMemcpy(Tres, Tres_gpu, sizeof(double) *num, cudaMemcpyDeviceToHost);
-	cudaThreadSynchronize();
-
-        for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i){
-            for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j){
-                for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k){
-                    T[i][j][k]=Tres[i][j][k];
-			
-		}
-	    }
-	}
-	FreeGrid(TBegin);
-	FreeGrid(TEnd);
-	FreeGrid(Tres);
-	FreeGrid(Tres_gpu);
-	FreeGrid(Thost);
-	FreeGrid(Thost0);
-	cudaFree(TBegin);
-	cudaFree(TEnd);
-	cudaFree(Tres_gpu);
+        cudaMemcpy(T.data(), TEnd, sizeof(floatT) * T.allocatedSize(), cudaMemcpyDeviceToHost);
+
+        /// combine the partial residuals of all thread blocks
+        cudaMemcpy(hostPartialResidual.data(), partialResidual, sizeof(floatT) * 2 * numBlocks, cudaMemcpyDeviceToHost);
+        Residual<floatT> residual;
+        for (unsigned index = 0; index < numBlocks; ++index) {
+            residual.maximum = std::max(residual.maximum, hostPartialResidual[index]);
+            residual.sumOfSquares += hostPartialResidual[numBlocks + index];
+        }
 
         /// now work on the halo cells
        
@@ -754,103 +640,13 @@ int main(int argc, char** argv)
          */
         MPI_Waitall(NUMBER_OF_DIMENSIONS * 2, request, status);
 
-        /// now that we have the halo cells, we update the boundaries using information from other processors
-      
-
-        if (neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::LEFT];
-            unsigned i = 0;
-            unsigned counter = 0;
-
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + THalo[counter++]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
-
-        /// do the same as above, this time for the right neighbor halo data
-      
-
-        if (neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::RIGHT];
-            unsigned i = chunck[COORDINATE::X] - 1;
-            unsigned counter = 0;
-
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (THalo[counter++] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
-
-        /// do the same as above, this time for the bottom neighbor halo data
-       
-        if (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::BOTTOM];
-            unsigned j = 0;
-            unsigned counter = 0;
-
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + THalo[counter++]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
-
-        /// do the same as above, this time for the top neighbor halo data
-      
-        if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::TOP];
-            unsigned j = chunck[COORDINATE::Y] - 1;
-            unsigned counter = 0;
-
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (THalo[counter++] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
-
-        /// do the same as above, this time for the back neighbor halo data
-        
-        if (neighbors[DIRECTION::BACK] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::BACK];
-            unsigned k = 0;
-            unsigned counter = 0;
-
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (T0[i][j][k + 1] - 2.0 * T0[i][j][k] + THalo[counter++]);
-                }
-        }
-
-        /// do the same as above, this time for the front neighbor halo data
-       
-        if (neighbors[DIRECTION::FRONT] != MPI_PROC_NULL) {
-            const auto& THalo = receiveBuffer[DIRECTION::FRONT];
-            unsigned k = chunck[COORDINATE::Z] - 1;
-            unsigned counter = 0;
-
-            for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j) {
-                    T[i][j][k] = T0[i][j][k] +
-                        Dx * (T0[i + 1][j][k] - 2.0 * T0[i][j][k] + T0[i - 1][j][k]) +
-                        Dy * (T0[i][j + 1][k] - 2.0 * T0[i][j][k] + T0[i][j - 1][k]) +
-                        Dz * (THalo[counter++] - 2.0 * T0[i][j][k] + T0[i][j][k - 1]);
-                }
-        }
+        /// now that we have the halo cells, we update the boundaries using information from other processors. The
+        /// face of each direction is updated by the same kernel, which reads the halo directly from the receive buffer
+        /// (see Face.h).
+        for (int direction = 0; direction < NUMBER_OF_DIMENSIONS * 2; ++direction)
+            if (neighbors[direction] != MPI_PROC_NULL)
+                computeFace(direction, T0, T, bufferFace(direction, receiveBuffer[direction].data(), chunck), Dx, Dy,
+                    Dz);
         /************************************************************************************************************
 
                                                                 GPU      END
@@ -863,25 +659,25 @@ int main(int argc, char** argv)
                 unsigned i = 0;
                 unsigned j = 0;
                 for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    T[i][j][k] = 2.0 * T[i + 1][j][k] - T[i + 2][j][k];
+                    T(i, j, k) = 2.0 * T(i + 1, j, k) - T(i + 2, j, k);
             }
             if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
                 unsigned i = 0;
                 unsigned j = chunck[COORDINATE::Y] - 1;
                 for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    T[i][j][k] = 2.0 * T[i + 1][j][k] - T[i + 2][j][k];
+                    T(i, j, k) = 2.0 * T(i + 1, j, k) - T(i + 2, j, k);
             }
             if (neighbors[DIRECTION::BACK] != MPI_PROC_NULL) {
                 unsigned i = 0;
                 unsigned k = 0;
                 for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    T[i][j][k] = 2.0 * T[i + 1][j][k] - T[i + 2][j][k];
+                    T(i, j, k) = 2.0 * T(i + 1, j, k) - T(i + 2, j, k);
             }
             if (neighbors[DIRECTION::FRONT] != MPI_PROC_NULL) {
                 unsigned i = 0;
                 unsigned k = chunck[COORDINATE::Z] - 1;
                 for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    T[i][j][k] = 2.0 * T[i + 1][j][k] - T[i + 2][j][k];
+                    T(i, j, k) = 2.0 * T(i + 1, j, k) - T(i + 2, j, k);
             }
         }
 
@@ -890,25 +686,25 @@ int main(int argc, char** argv)
                 unsigned i = chunck[COORDINATE::X] - 1;
                 unsigned j = 0;
                 for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    T[i][j][k] = 2.0 * T[i - 1][j][k] - T[i - 2][j][k];
+                    T(i, j, k) = 2.0 * T(i - 1, j, k) - T(i - 2, j, k);
             }
             if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
                 unsigned i = chunck[COORDINATE::X] - 1;
                 unsigned j = chunck[COORDINATE::Y] - 1;
                 for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    T[i][j][k] = 2.0 * T[i - 1][j][k] - T[i - 2][j][k];
+                    T(i, j, k) = 2.0 * T(i - 1, j, k) - T(i - 2, j, k);
             }
             if (neighbors[DIRECTION::BACK] != MPI_PROC_NULL) {
                 unsigned i = chunck[COORDINATE::X] - 1;
                 unsigned k = 0;
                 for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    T[i][j][k] = 2.0 * T[i - 1][j][k] - T[i - 2][j][k];
+                    T(i, j, k) = 2.0 * T(i - 1, j, k) - T(i - 2, j, k);
             }
             if (neighbors[DIRECTION::FRONT] != MPI_PROC_NULL) {
                 unsigned i = chunck[COORDINATE::X] - 1;
                 unsigned k = chunck[COORDINATE::Z] - 1;
                 for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                    T[i][j][k] = 2.0 * T[i - 1][j][k] - T[i - 2][j][k];
+                    T(i, j, k) = 2.0 * T(i - 1, j, k) - T(i - 2, j, k);
             }
         }
 
@@ -917,13 +713,13 @@ int main(int argc, char** argv)
                 unsigned j = 0;
                 unsigned k = 0;
                 for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                    T[i][j][k] = 2.0 * T[i][j][k + 1] - T[i][j][k + 2];
+                    T(i, j, k) = 2.0 * T(i, j, k + 1) - T(i, j, k + 2);
             }
             if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
                 unsigned j = chunck[COORDINATE::Y] - 1;
                 unsigned k = 0;
                 for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                    T[i][j][k] = 2.0 * T[i][j][k + 1] - T[i][j][k + 2];
+                    T(i, j, k) = 2.0 * T(i, j, k + 1) - T(i, j, k + 2);
             }
         }
 
@@ -932,13 +728,13 @@ int main(int argc, char** argv)
                 unsigned j = 0;
                 unsigned k = chunck[COORDINATE::Z] - 1;
                 for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                    T[i][j][k] = 2.0 * T[i][j][k - 1] - T[i][j][k - 2];
+                    T(i, j, k) = 2.0 * T(i, j, k - 1) - T(i, j, k - 2);
             }
             if (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) {
                 unsigned j = chunck[COORDINATE::Y] - 1;
                 unsigned k = chunck[COORDINATE::Z] - 1;
                 for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                    T[i][j][k] = 2.0 * T[i][j][k - 1] - T[i][j][k - 2];
+                    T(i, j, k) = 2.0 * T(i, j, k - 1) - T(i, j, k - 2);
             }
         }
         /// finished with halo edges extrapolation
@@ -951,7 +747,7 @@ int main(int argc, char** argv)
             unsigned i = 0;
             unsigned j = 0;
             unsigned k = 0;
-            T[i][j][k] = 1.0 / 3.0 * (T[i + 1][j][k] + T[i][j + 1][k] + T[i][j][k + 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i + 1, j, k) + T(i, j + 1, k) + T(i, j, k + 1));
         }
 
         if ((neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) && (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) &&
@@ -959,7 +755,7 @@ int main(int argc, char** argv)
             unsigned i = 0;
             unsigned j = 0;
             unsigned k = chunck[COORDINATE::Z] - 1;
-            T[i][j][k] = 1.0 / 3.0 * (T[i + 1][j][k] + T[i][j + 1][k] + T[i][j][k - 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i + 1, j, k) + T(i, j + 1, k) + T(i, j, k - 1));
         }
 
         if ((neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) && (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) &&
@@ -967,7 +763,7 @@ int main(int argc, char** argv)
             unsigned i = 0;
             unsigned j = chunck[COORDINATE::Y] - 1;
             unsigned k = 0;
-            T[i][j][k] = 1.0 / 3.0 * (T[i + 1][j][k] + T[i][j - 1][k] + T[i][j][k + 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i + 1, j, k) + T(i, j - 1, k) + T(i, j, k + 1));
         }
 
         if ((neighbors[DIRECTION::LEFT] != MPI_PROC_NULL) && (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) &&
@@ -975,7 +771,7 @@ int main(int argc, char** argv)
             unsigned i = 0;
             unsigned j = chunck[COORDINATE::Y] - 1;
             unsigned k = chunck[COORDINATE::Z] - 1;
-            T[i][j][k] = 1.0 / 3.0 * (T[i + 1][j][k] + T[i][j - 1][k] + T[i][j][k - 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i + 1, j, k) + T(i, j - 1, k) + T(i, j, k - 1));
         }
 
         if ((neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) && (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) &&
@@ -983,7 +779,7 @@ int main(int argc, char** argv)
             unsigned i = chunck[COORDINATE::X] - 1;
             unsigned j = 0;
             unsigned k = 0;
-            T[i][j][k] = 1.0 / 3.0 * (T[i - 1][j][k] + T[i][j + 1][k] + T[i][j][k + 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i - 1, j, k) + T(i, j + 1, k) + T(i, j, k + 1));
         }
 
         if ((neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) && (neighbors[DIRECTION::BOTTOM] != MPI_PROC_NULL) &&
@@ -991,7 +787,7 @@ int main(int argc, char** argv)
             unsigned i = chunck[COORDINATE::X] - 1;
             unsigned j = 0;
             unsigned k = chunck[COORDINATE::Z] - 1;
-            T[i][j][k] = 1.0 / 3.0 * (T[i - 1][j][k] + T[i][j + 1][k] + T[i][j][k - 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i - 1, j, k) + T(i, j + 1, k) + T(i, j, k - 1));
         }
 
         if ((neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) && (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) &&
@@ -999,7 +795,7 @@ int main(int argc, char** argv)
             unsigned i = chunck[COORDINATE::X] - 1;
             unsigned j = chunck[COORDINATE::Y] - 1;
             unsigned k = 0;
-            T[i][j][k] = 1.0 / 3.0 * (T[i - 1][j][k] + T[i][j - 1][k] + T[i][j][k + 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i - 1, j, k) + T(i, j - 1, k) + T(i, j, k + 1));
         }
 
         if ((neighbors[DIRECTION::RIGHT] != MPI_PROC_NULL) && (neighbors[DIRECTION::TOP] != MPI_PROC_NULL) &&
@@ -1007,21 +803,16 @@ int main(int argc, char** argv)
             unsigned i = chunck[COORDINATE::X] - 1;
             unsigned j = chunck[COORDINATE::Y] - 1;
             unsigned k = chunck[COORDINATE::Z] - 1;
-            T[i][j][k] = 1.0 / 3.0 * (T[i - 1][j][k] + T[i][j - 1][k] + T[i][j][k - 1]);
+            T(i, j, k) = 1.0 / 3.0 * (T(i - 1, j, k) + T(i, j - 1, k) + T(i, j, k - 1));
         }
         /// finished with halo corner points
      
 
 
-/// calculate the difference between the current and previous (last time step) solution.
+/// the difference between the current and previous (last time step) solution, reduced by computeT(...).
   
 
-        floatT res = std::numeric_limits<floatT>::min();
-        for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-            for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
-                for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
-                    if (std::fabs(T[i][j][k] - T0[i][j][k]) > res)
-                        res = std::fabs(T[i][j][k] - T0[i][j][k]);
+        floatT res = std::max(std::numeric_limits<floatT>::min(), residual.maximum);
 
         /// if it is the first time step, store the residual as the normalisation factor
       
@@ -1098,7 +889,7 @@ int main(int argc, char** argv)
     for (unsigned k = 1; k < chunck[COORDINATE::Z] - 1; ++k)
         for (unsigned j = 1; j < chunck[COORDINATE::Y] - 1; ++j)
             for (unsigned i = 1; i < chunck[COORDINATE::X] - 1; ++i)
-                error += std::sqrt(std::pow(T[i][j][k] - (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y], 2.0));
+                error += std::sqrt(std::pow(T(i, j, k) - (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y], 2.0));
     error /= ((chunck[COORDINATE::X] - 2) * (chunck[COORDINATE::Y] - 2) * (chunck[COORDINATE::Z] - 2));
     MPI_Iallreduce(&error, &globalError, 1, MPI_FLOAT_T, MPI_SUM, MPI_COMM_CART, &reduceRequest);
     MPI_Wait(&reduceRequest, MPI_STATUS_IGNORE);
@@ -1117,7 +908,7 @@ int main(int argc, char** argv)
         for (unsigned k = 0; k < chunck[COORDINATE::Z]; ++k)
             for (unsigned j = 0; j < chunck[COORDINATE::Y]; ++j)
                 for (unsigned i = 0; i < chunck[COORDINATE::X]; ++i)
-                    receiveBufferPostProcess[counter++] = T[i][j][k];
+                    receiveBufferPostProcess[counter++] = T(i, j, k);
 
         MPI_Send(&receiveBufferPostProcess[0], chunck[COORDINATE::X] * chunck[COORDINATE::Y] * chunck[COORDINATE::Z], MPI_FLOAT_T, 0, 200 + rank, MPI_COMM_CART);
         MPI_Send(&coordinates3D[0], NUMBER_OF_DIMENSIONS, MPI_INT, 0, 300 + rank, MPI_COMM_CART);
@@ -1135,7 +926,7 @@ int main(int argc, char** argv)
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::X] * (chunck[COORDINATE::X] - 1) + i) * spacing[COORDINATE::X];
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::Z] * (chunck[COORDINATE::Z] - 1) + k) * spacing[COORDINATE::Z];
-                    out << std::scientific << std::setprecision(5) << std::setw(15) << T[i][j][k];
+                    out << std::scientific << std::setprecision(5) << std::setw(15) << T(i, j, k);
                     out << std::fixed << std::setw(5) << rank << std::endl;
                 }
 
@@ -1173,13 +964,17 @@ int main(int argc, char** argv)
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::X] * (chunck[COORDINATE::X] - 1) + i) * spacing[COORDINATE::X];
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::Y] * (chunck[COORDINATE::Y] - 1) + j) * spacing[COORDINATE::Y];
                     out << std::scientific << std::setprecision(5) << std::setw(15) << (coordinates3D[COORDINATE::Z] * (chunck[COORDINATE::Z] - 1) + k) * spacing[COORDINATE::Z];
-                    out << std::scientific << std::setprecision(5) << std::setw(15) << T[i][j][k] << std::endl;
+                    out << std::scientific << std::setprecision(5) << std::setw(15) << T(i, j, k) << std::endl;
                 }
         out.close();
     }
 
 
 
+    cudaFree(TBegin);
+    cudaFree(TEnd);
+    cudaFree(partialResidual);
+
     MPI_Finalize();
 
     return 0;